@@ -20,12 +20,20 @@
 #define DTMF_BG_LIB___
 
 #include <cctype>
+#include <cstdint>
 #include <string>
 #include <map>
 #include <array>
+#include <deque>
 #include <vector>
 #include <tuple>
+#include <memory>
 #include <utility>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
@@ -43,28 +51,559 @@ namespace dtmfutil {
     using  DtmfAttrib     =  std::tuple<int, int, RawSoundArray>;
     enum   DtmfAttribIdx  {  TONE_1, TONE_2, DATA };
     using  DtmfMap        =  std::map<char, DtmfAttrib>;
+    enum   SampleFormat   {  FORMAT_U8, FORMAT_S16_LE, FORMAT_FLOAT };
 
-    class AlsaPlay{
+    constexpr size_t  sampleBytes(SampleFormat fmt) noexcept{
+        return fmt == FORMAT_U8 ? 1 : (fmt == FORMAT_S16_LE ? 2 : 4);
+    }
+
+    SampleFormat      formatFromName(const std::string& name);
+    void              convertSamples(const float*   in,
+                                     size_t         len,
+                                     SampleFormat   fmt,
+                                     unsigned char* out)                        noexcept;
+
+    constexpr size_t  DTMF_FREQS                       { 4 };
+    constexpr int     dtmfRowFreq[DTMF_FREQS]          { 697,  770,  852,  941  };
+    constexpr int     dtmfColFreq[DTMF_FREQS]          { 1209, 1336, 1477, 1633 };
+    constexpr char    dtmfKeypad[DTMF_FREQS][DTMF_FREQS] { { '1', '2', '3', 'A' },
+                                                           { '4', '5', '6', 'B' },
+                                                           { '7', '8', '9', 'C' },
+                                                           { '*', '0', '#', 'D' } };
+
+    // Nibble to symbol mapping of the plain data encoding.
+    constexpr char    dtmfDigits[0x10]                 { '0', '1', '2', '3', '4', '5', '6', '7',
+                                                         '8', '9', 'A', 'B', 'C', 'D', '#', '*' };
+
+    constexpr size_t  SINE_TABLE_BITS                  { 12 };
+    constexpr size_t  SINE_TABLE_SIZE                  { 1U << SINE_TABLE_BITS };
+
+    // Sine table indexed by the upper bits of the 16 bit phase accumulator:
+    // it's built at compile time, so tone synthesis needs no sinf() call.
+    class SineTable{
         public:
-            AlsaPlay(size_t sSize, std::string dev="default");
+            constexpr SineTable(void) noexcept
+             : table{}
+            {
+                for(size_t idx{ 0 }; idx < SINE_TABLE_SIZE; ++idx)
+                    table[idx] = static_cast<float>(sine(2.0 * PI * idx / SINE_TABLE_SIZE));
+            }
+
+            constexpr float operator()(uint16_t phase)                  const   noexcept{
+                return table[phase >> (16 - SINE_TABLE_BITS)];
+            }
+
+            constexpr void  synth(int            freq1,
+                                  int            freq2,
+                                  size_t         sSize,
+                                  size_t         len,
+                                  unsigned char* out)                   const   noexcept{
+                const unsigned int ad1 { static_cast<unsigned int>((freq1 << 16) / sSize) },
+                                   ad2 { static_cast<unsigned int>((freq2 << 16) / sSize) };
+                uint16_t           c1  { 0 },
+                                   c2  { 0 };
+
+                for(size_t idx{ 0 }; idx < len; ++idx){
+                    const float y { ((*this)(c1) + (*this)(c2)) * 0.5F };
+                    out[idx]  =  static_cast<unsigned char>((y + 1.0F) * 127.0F);
+                    c1        =  static_cast<uint16_t>(c1 + ad1);
+                    c2        =  static_cast<uint16_t>(c2 + ad2);
+                }
+            }
+
+            constexpr void  synth(int            freq1,
+                                  int            freq2,
+                                  size_t         sSize,
+                                  size_t         len,
+                                  float*         out)                   const   noexcept{
+                const unsigned int ad1 { static_cast<unsigned int>((freq1 << 16) / sSize) },
+                                   ad2 { static_cast<unsigned int>((freq2 << 16) / sSize) };
+                uint16_t           c1  { 0 },
+                                   c2  { 0 };
+
+                for(size_t idx{ 0 }; idx < len; ++idx){
+                    out[idx]  =  ((*this)(c1) + (*this)(c2)) * 0.5F;
+                    c1        =  static_cast<uint16_t>(c1 + ad1);
+                    c2        =  static_cast<uint16_t>(c2 + ad2);
+                }
+            }
+
+        private:
+            static constexpr double PI  { 3.14159265358979323846 };
+
+            float                   table[SINE_TABLE_SIZE];
+
+            static constexpr double sine(double x)                              noexcept{
+                if(x > PI)            x -= 2.0 * PI;
+                if(x > PI / 2.0)      x  = PI - x;
+                else if(x < -PI / 2.0) x = -PI - x;
+
+                double term { x },
+                       sum  { x };
+                for(int n{ 1 }; n < 12; ++n){
+                    term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+                    sum  += term;
+                }
+                return sum;
+            }
+    };
+
+    // Whole tone bank for a sample rate / tone length known at compile time,
+    // tones stored in dtmfKeypad order.
+    template<size_t RATE, size_t TLEN>
+    class StaticToneBank{
+        public:
+            static constexpr size_t SAMPLES { (TLEN * RATE) / 1000 };
+
+            constexpr StaticToneBank(void) noexcept
+             : data{}
+            {
+                const SineTable sine;
+                for(size_t row{ 0 }; row < DTMF_FREQS; ++row)
+                    for(size_t col{ 0 }; col < DTMF_FREQS; ++col)
+                        sine.synth(dtmfColFreq[col], dtmfRowFreq[row], RATE, SAMPLES,
+                                   data[row * DTMF_FREQS + col]);
+            }
+
+            const unsigned char* tone(size_t row, size_t col)           const   noexcept{
+                return data[row * DTMF_FREQS + col];
+            }
+
+        private:
+            unsigned char           data[DTMF_FREQS * DTMF_FREQS][SAMPLES];
+    };
+
+    struct DtmfTiming{
+        size_t   toneMs,
+                 gapMs,
+                 pauseMs;
+
+        static DtmfTiming  fromName(const std::string& name);
+    };
+
+    // Named profiles: the original 250 ms tones, a faster variant and the
+    // ITU-T Q.24 minimums (40 ms tone, 40 ms inter-digit pause).
+    constexpr DtmfTiming  TIMING_CLASSIC  { 250, 25, 25 };
+    constexpr DtmfTiming  TIMING_FAST     { 100, 25, 25 };
+    constexpr DtmfTiming  TIMING_ITU_Q24  {  40, 40, 40 };
+
+    struct ToneSlot{
+        uint32_t  offset,
+                  length;
+    };
+
+    // All the tones of a Dtmf object, plus gap and pause, in one aligned
+    // arena: a symbol is resolved with a single load from a 256 entries table.
+    // A bank is immutable, so many Dtmf objects can share it; it can be saved
+    // to a file and memory mapped by later processes instead of synthesized.
+    class ToneBank{
+        public:
+            static constexpr uint32_t  NO_TONE   { 0xFFFFFFFF };
+            static constexpr size_t    ALIGNMENT { 64 };
+
+            ToneBank(size_t             sSize,
+                     const DtmfTiming&  tm,
+                     size_t             tlen,
+                     SampleFormat       fmt  =  FORMAT_U8);
+
+            // Written to a temporary file renamed over fileName, so concurrent
+            // writers and readers always see a whole bank.
+            bool                  saveTo(const std::string& fileName)   const   noexcept;
+            // Maps a saved bank read only; throws if it isn't a valid bank of this build.
+            static std::shared_ptr<const ToneBank>  load(const std::string& fileName);
+            // The bank saved in fileName if it matches the parameters, otherwise a
+            // new one, saved there for the next time.
+            static std::shared_ptr<const ToneBank>  cached(const std::string& fileName,
+                                                           size_t             sSize,
+                                                           const DtmfTiming&  tm,
+                                                           size_t             tlen,
+                                                           SampleFormat       fmt  =  FORMAT_U8);
+
+            const ToneSlot&       slot(char sym)                        const   noexcept{
+                return index[static_cast<unsigned char>(sym)];
+            }
+            const ToneSlot&       gap(void)                             const   noexcept{
+                return gapSlot;
+            }
+            const unsigned char*  data(const ToneSlot& sl)              const   noexcept{
+                return base + sl.offset;
+            }
+            size_t                getSampleSize(void)                   const   noexcept;
+            size_t                getToneLen(void)                      const   noexcept;
+            size_t                getToneMs(void)                       const   noexcept;
+            SampleFormat          getFormat(void)                       const   noexcept;
+            const DtmfTiming&     getTiming(void)                       const   noexcept;
+
+        private:
+            std::shared_ptr<unsigned char>      storage;
+            const unsigned char*                base;
+            std::array<ToneSlot, 256>           index;
+            ToneSlot                            gapSlot;
+            size_t                              sampleSize,
+                                                toneLen,
+                                                toneMs,
+                                                arenaSize;
+            SampleFormat                        format;
+            DtmfTiming                          timing;
+
+            ToneBank(void)                                                   noexcept;
+    };
+
+    // Synthesizes the queued symbols on demand, into buffers of any size:
+    // memory doesn't depend on the tone length and the oscillators keep their
+    // phase from a tone to the next one. Push and fill can be called by
+    // different threads.
+    class ToneGenerator{
+        public:
+            explicit ToneGenerator(size_t             sSize    =  8000,
+                                   const DtmfTiming&  tm       =  TIMING_CLASSIC,
+                                   SampleFormat       fmt      =  FORMAT_U8,
+                                   bool               whsound  =  true);
+
+            // Queues a tone of toneMs, a pause for ' ', 0 uses the timing; every
+            // symbol is followed by the timing gap if whsound was given.
+            bool                  push(char sym,
+                                       size_t toneMs  =  0)                     noexcept;
+            // Stops at the first invalid symbol.
+            bool                  push(const char* const ch,
+                                       size_t            len)                   noexcept;
+            bool                  push(const std::string& str)                  noexcept;
+            // Both write up to frames samples and return how many: fewer only
+            // when the queue runs out.
+            size_t                fill(unsigned char* out,
+                                       size_t         frames)                   noexcept;
+            size_t                fill(float*         out,
+                                       size_t         frames)                   noexcept;
+            size_t                pending(void)                         const   noexcept;
+            void                  reset(void)                                   noexcept;
+
+            SampleFormat          getFormat(void)                       const   noexcept;
+            // A copy: push() may rewrite it from the other thread.
+            std::string           getErrMsg(void)                       const;
+
+        private:
+            static constexpr size_t  BLOCK { 256 };     // Float samples converted per step
+
+            // A tone, or silence when both increments are zero.
+            struct Step{
+                uint32_t  inc1,
+                          inc2;
+                size_t    left;
+            };
+
+            size_t                   sampleSize;
+            DtmfTiming               timing;
+            SampleFormat             format;
+            bool                     whiteSound;
+            std::deque<Step>         steps;
+            size_t                   queued;
+            uint32_t                 phase1,
+                                     phase2;
+            mutable std::mutex       lock;
+            std::string              errMsg;
+
+            size_t                samples(size_t ms)                    const   noexcept;
+            void                  synth(Step&  st,
+                                        float* out,
+                                        size_t len)                             noexcept;
+            void                  consumed(size_t len)                          noexcept;
+    };
+
+    // Lock-free ring of bytes between one producer and one consumer thread.
+    class ByteRing{
+        public:
+            explicit ByteRing(size_t cap);                  // Rounded up to a power of two
+
+            size_t   write(const unsigned char* data, size_t len)                noexcept;
+            size_t   read(unsigned char* data, size_t len)                       noexcept;
+            size_t   readable(void)                                     const   noexcept;
+            size_t   capacity(void)                                     const   noexcept;
+
+        private:
+            std::vector<unsigned char>        buff;
+            size_t                            mask;
+            alignas(64) std::atomic<size_t>   head;         // Advanced by the producer
+            alignas(64) std::atomic<size_t>   tail;         // Advanced by the consumer
+    };
+
+    enum PlayStatus { PLAY_PENDING, PLAY_DONE, PLAY_CANCELLED, PLAY_FAILED };
+
+    using PlayCallback  =  std::function<void(PlayStatus status, const std::string& errmsg)>;
+
+    // A sequence submitted for asynchronous playback; the callback, if any,
+    // runs on the playback thread once, when the job leaves PLAY_PENDING.
+    struct PlayJob{
+        PlayJob(RawSoundArray&& data, PlayCallback&& cb);
+
+        void                            finish(PlayStatus st, const std::string& err)   noexcept;
+
+        const RawSoundArray             pcm;
+        const PlayCallback              callback;
+        std::atomic<bool>               cancelled;
+        std::atomic<PlayStatus>         status;
+        std::string                     errMsg;
+        std::promise<PlayStatus>        promise;
+        std::shared_future<PlayStatus>  result;
+    };
+
+    class PlayHandle{
+        public:
+            PlayHandle(void)                                                         = default;
+            explicit PlayHandle(std::shared_ptr<PlayJob> jb)                           noexcept;
+
+            // Pending jobs never start, a playing one stops within a poll period.
+            void                             cancel(void)                const   noexcept;
+            PlayStatus                       status(void)                const   noexcept;
+            PlayStatus                       wait(void)                  const;
+            std::shared_future<PlayStatus>   future(void)                const;
+            const std::string&               getErrMsg(void)             const   noexcept;
+
+        private:
+            std::shared_ptr<PlayJob>         job;
+    };
+
+    // Playback counters of a sink; Dtmf adds the symbols played and the time
+    // spent playing them. Latency bucket n counts the writes that took less
+    // than 2^n microseconds, the last one the slower ones.
+    struct PlayStats{
+        static constexpr size_t  LATENCY_BUCKETS { 24 };
+
+        uint64_t  writes,
+                  frames,
+                  xruns,
+                  shortWrites,
+                  failures,
+                  maxLatencyUs,
+                  latency[LATENCY_BUCKETS],
+                  symbols;
+        double    seconds;
+
+        double    symbolRate(void)                                      const   noexcept;
+    };
+
+    std::ostream& operator<< (std::ostream& out, const PlayStats& stats);
+
+    // Updated by the writer threads, read at any time.
+    class PlayCounters{
+        public:
+            PlayCounters(void)                                                      noexcept;
+
+            // A write of requested frames, written the ones accepted or the error.
+            void       write(uint64_t requested,
+                             long     written,
+                             uint64_t micros)                                      noexcept;
+            void       xrun(void)                                                  noexcept;
+            void       failure(void)                                               noexcept;
+            PlayStats  snapshot(void)                                   const   noexcept;
+
+        private:
+            std::atomic<uint64_t>  writes,
+                                   frames,
+                                   xruns,
+                                   shortWrites,
+                                   failures,
+                                   maxLatencyUs,
+                                   latency[PlayStats::LATENCY_BUCKETS];
+    };
+
+    // Sinks receive interleaved samples in their format, len is in bytes.
+    class AudioSink{
+        public:
+            explicit AudioSink(SampleFormat fmt   = FORMAT_U8,
+                               size_t       chans = 1)                              noexcept;
+            virtual ~AudioSink(void)                                               = default;
+
+            virtual bool play(const unsigned char* data,
+                              size_t               len,
+                              std::string&         errmsg)              const   noexcept = 0;
+                    bool play(const RawSoundArray& arr,
+                              std::string&         errmsg)              const   noexcept;
+            // Queues pcm and returns at once where the sink supports it;
+            // the default implementation plays it before returning.
+            virtual PlayHandle submit(RawSoundArray pcm,
+                                      PlayCallback  cb  =  nullptr)     const;
+            // Pulls the generator a period at a time until its queue is empty.
+                    bool play(ToneGenerator&       gen,
+                              std::string&         errmsg)              const   noexcept;
+            // Frames the sink prefers in a single write.
+            virtual size_t   getPeriod(void)                            const   noexcept;
+            // Sinks without counters return all zeros.
+            virtual PlayStats getStats(void)                            const   noexcept;
+            SampleFormat     getFormat(void)                            const   noexcept;
+            size_t           getChannels(void)                          const   noexcept;
+
+        protected:
+            SampleFormat     format;
+            size_t           channels;
+    };
+
+    class AlsaAsync;
+
+    class AlsaPlay : public AudioSink{
+        public:
+            AlsaPlay(size_t sSize, std::string dev="default", SampleFormat fmt=FORMAT_U8,
+                     size_t chans=1);
             ~AlsaPlay(void);
 
-            bool play(const RawSoundArray& arr, 
-                      std::string& errmsg)                              const   noexcept;
+            using AudioSink::play;
+            bool play(const unsigned char* data,
+                      size_t               len,
+                      std::string&         errmsg)                      const   noexcept override;
+            // Jobs are played in order by a thread polling the pcm, which is
+            // switched to non blocking mode; play() then queues a job and waits.
+            PlayHandle submit(RawSoundArray pcm,
+                              PlayCallback  cb  =  nullptr)             const   override;
+            size_t     getPeriod(void)                                  const   noexcept override;
+            PlayStats  getStats(void)                                   const   noexcept override;
+
+            static size_t nativeRate(const std::string& dev="default");
 
         private:
             snd_pcm_t*                  handle;
-            mutable snd_pcm_sframes_t   frames;
             std::string                 device;
+            size_t                      sampleSize,
+                                        writeSize,
+                                        periodFrames,
+                                        frameBytes;
+            mutable std::mutex          asyncLock;
+            mutable std::shared_ptr<AlsaAsync>  async;
+            mutable PlayCounters        counters;
+    };
+
+    class RawFileSink : public AudioSink{
+        public:
+            explicit RawFileSink(const std::string& fileName,
+                                 SampleFormat       fmt   =  FORMAT_U8,
+                                 size_t             chans =  1);
+            ~RawFileSink(void);
+
+            using AudioSink::play;
+            bool play(const unsigned char* data,
+                      size_t               len,
+                      std::string&         errmsg)                      const   noexcept override;
+
+        private:
+            mutable std::ofstream       oFile;
+    };
+
+    class WavFileSink : public AudioSink{
+        public:
+            WavFileSink(const std::string& fileName,
+                        size_t             sSize,
+                        SampleFormat       fmt   =  FORMAT_U8,
+                        size_t             chans =  1);
+            ~WavFileSink(void);
+
+            using AudioSink::play;
+            bool play(const unsigned char* data,
+                      size_t               len,
+                      std::string&         errmsg)                      const   noexcept override;
+            void close(void)                                                    noexcept;
+
+        private:
+            mutable std::ofstream       oFile;
+            mutable uint32_t            dataLen;
             size_t                      sampleSize;
     };
 
+    class MemorySink : public AudioSink{
+        public:
+            explicit MemorySink(SampleFormat fmt   = FORMAT_U8,
+                                size_t       chans = 1)                             noexcept;
+
+            using AudioSink::play;
+            bool play(const unsigned char* data,
+                      size_t               len,
+                      std::string&         errmsg)                      const   noexcept override;
+
+            const RawSoundArray&  getData(void)                         const   noexcept;
+            void                  clear(void)                                   noexcept;
+
+        private:
+            mutable RawSoundArray       data;
+    };
+
+    // Sources give interleaved samples in their format: read() waits for
+    // them, frames is the room in data on entry, the frames read on return,
+    // zero at the end of the stream.
+    class AudioSource{
+        public:
+            AudioSource(size_t       sSize,
+                        SampleFormat fmt,
+                        size_t       chans)                                         noexcept;
+            virtual ~AudioSource(void)                                             = default;
+
+            virtual bool read(unsigned char*       data,
+                              size_t&              frames,
+                              std::string&         errmsg)              const   noexcept = 0;
+            // Frames worth a single read, 10 ms by default.
+            virtual size_t   getPeriod(void)                            const   noexcept;
+            size_t           getSampleSize(void)                        const   noexcept;
+            SampleFormat     getFormat(void)                            const   noexcept;
+            size_t           getChannels(void)                          const   noexcept;
+
+        protected:
+            size_t           sampleSize;
+            SampleFormat     format;
+            size_t           channels;
+    };
+
+    class AlsaCapture : public AudioSource{
+        public:
+            AlsaCapture(size_t sSize, std::string dev="default", SampleFormat fmt=FORMAT_S16_LE,
+                        size_t chans=1);
+            ~AlsaCapture(void);
+
+            // Overruns are recovered and counted, the samples lost are skipped.
+            bool       read(unsigned char*       data,
+                            size_t&              frames,
+                            std::string&         errmsg)                const   noexcept override;
+            size_t     getPeriod(void)                                  const   noexcept override;
+            uint64_t   getOverruns(void)                                const   noexcept;
+
+        private:
+            snd_pcm_t*                      handle;
+            std::string                     device;
+            size_t                          periodFrames;
+            mutable std::atomic<uint64_t>   overruns;
+    };
+
+    // U8, S16 or float WAV files, streamed.
+    class WavFileSource : public AudioSource{
+        public:
+            explicit WavFileSource(const std::string& fileName);
+
+            bool       read(unsigned char*       data,
+                            size_t&              frames,
+                            std::string&         errmsg)                const   noexcept override;
+
+        private:
+            mutable std::ifstream       iFile;
+            mutable size_t              left;
+    };
+
     class Dtmf{
         public:
             explicit             Dtmf(size_t sSize      =  8000,
                                       size_t whiteFract =  40,
                                       bool   whsound    =  true);
-            void                 init(size_t tlen       =  250)                 noexcept;
+            explicit             Dtmf(std::shared_ptr<AudioSink> snk,
+                                      size_t sSize      =  8000,
+                                      size_t whiteFract =  40,
+                                      bool   whsound    =  true);
+            explicit             Dtmf(const DtmfTiming& tm,
+                                      size_t sSize      =  8000,
+                                      bool   whsound    =  true);
+                                 Dtmf(std::shared_ptr<AudioSink> snk,
+                                      const DtmfTiming& tm,
+                                      size_t sSize      =  8000,
+                                      bool   whsound    =  true);
+            // Ready to play with a shared bank, which gives timing and sample rate:
+            // init() isn't needed.
+                                 Dtmf(std::shared_ptr<AudioSink>       snk,
+                                      std::shared_ptr<const ToneBank>  tones,
+                                      bool   whsound    =  true);
+            bool                 init(size_t tlen       =  0)                   noexcept;
             bool                 play(const std::string& str)           const   noexcept;
             bool                 play(char ch)                          const   noexcept;
             bool                 play(const char* const ch,
@@ -72,33 +611,272 @@ namespace dtmfutil {
             bool                 play(const std::vector<char>& vec,
                                       size_t            len)            const   noexcept;
             bool                 play(const std::vector<char>& vec)     const   noexcept;
+            bool                 render(const char* const ch,
+                                        size_t            len,
+                                        RawSoundArray&    out)          const   noexcept;
+            // Plays the symbols read from fd until end of file: a reader thread, a
+            // renderer working ahead of the sink and the sink writer run in parallel.
+            // Whitespace (newlines, tabs) is ignored, other invalid symbols are
+            // skipped and counted; log, if any, gets every read length.
+            bool                 playStream(int               fd,
+                                            std::ostream*     log = nullptr) const  noexcept;
+            // Invalid symbols skipped by the last playStream().
+            uint64_t             getSkipped(void)                       const   noexcept;
+            // Renders str and hands it to the sink without waiting for the playback.
+            PlayHandle           submit(const std::string& str,
+                                        PlayCallback       cb  = nullptr)  const;
 
             static float         bgsine(short in)                               noexcept;
+            const DtmfTiming&    getTiming(void)                        const   noexcept;
+            std::shared_ptr<const ToneBank>  getBank(void)              const   noexcept;
+            // The counters of the sink plus symbols played and achieved rate.
+            PlayStats            getStats(void)                         const   noexcept;
             const std::string&   getErrMsg(void)                        const   noexcept;
 
         private:
             size_t                sampleSize,
                                   sampleNum;
-            DtmfMap               dtmfMap;
-            AlsaPlay              aplay;
-            RawSoundArray         white;
+            std::shared_ptr<AudioSink>       sink;
+            std::shared_ptr<const ToneBank>  bank;
+            DtmfTiming            timing;
             bool                  whiteSound;
+            mutable RawSoundArray renderBuff;
             mutable std::string   errMsg;
+            mutable std::atomic<uint64_t>  symbolsPlayed,
+                                           playNanos,
+                                           symbolsSkipped;
+
+            // Adds the symbols and the time elapsed since start.
+            void                  played(size_t count,
+                                         std::chrono::steady_clock::time_point start) const noexcept;
+            bool                  playBatch(const char* const ch,
+                                            size_t            len)      const   noexcept;
 
             friend std::istream& operator>> (std::istream& in, const Dtmf& dtmf);
         };
 
+    // A symbol detected and the sample, counted from the last reset, where it was.
+    using SymbolCallback  =  std::function<void(char sym, uint64_t sample)>;
+
+    class DtmfDecoder{
+        public:
+            static constexpr size_t  MIX_CHANNELS { SIZE_MAX };
+
+            explicit             DtmfDecoder(size_t sSize    =  8000,
+                                             size_t blockMs  =  10);
+
+            void                 reset(void)                                    noexcept;
+            void                 feed(const unsigned char* pcm,
+                                      size_t               len)                 noexcept;
+            void                 feed(const int16_t*       pcm,
+                                      size_t               len)                 noexcept;
+            void                 feed(const float*         pcm,
+                                      size_t               len)                 noexcept;
+            // Interleaved frames in fmt; channel selects one, by default they're mixed.
+            // Frames without that channel are ignored and set getErrMsg().
+            void                 feed(const unsigned char* pcm,
+                                      size_t               frames,
+                                      SampleFormat         fmt,
+                                      size_t               chans,
+                                      size_t               channel = MIX_CHANNELS) noexcept;
+            // End of the stream: a tone still sounding ends here, so the
+            // repeats found by clock recovery in it are emitted.
+            void                 flush(void)                                    noexcept;
+            // Symbols are emitted two blocks after the tone starts; with a
+            // callback they're passed to it instead of collected in getSymbols().
+            void                 setCallback(SymbolCallback cb)                noexcept;
+            std::string          decode(const RawSoundArray& pcm)               noexcept;
+            // channel selects one channel of the recording, by default they're mixed.
+            // With threads other than 1 (0 for all the cores) the recording is cut
+            // in segments at tone free stretches, decoded in parallel and stitched.
+            std::string          decodeWav(const std::string& fileName,
+                                           size_t             channel = MIX_CHANNELS,
+                                           size_t             threads = 1);
+            bool                 saveTo(const std::string& wavFile,
+                                        const std::string& outFile,
+                                        size_t             channel = MIX_CHANNELS,
+                                        size_t             threads = 1)        noexcept;
+
+            // Clock recovery learns the tone and gap lengths from the signal and
+            // tracks their drift: dropouts shorter than the rest of a tone are
+            // bridged and, when the gaps are short enough to vanish, a run of
+            // one symbol lasting close to n tones counts n times. Off by
+            // default: a keypad held down is one long tone.
+            void                 setClockRecovery(bool on)                      noexcept;
+            // Estimated lengths in ms, 0 until enough tones were seen.
+            float                getToneMs(void)                        const   noexcept;
+            float                getGapMs(void)                         const   noexcept;
+            const std::string&   getSymbols(void)                       const   noexcept;
+            const std::string&   getErrMsg(void)                        const   noexcept;
+
+        private:
+            // Tone and gap estimates, in blocks, the spread of the tone lengths
+            // around the estimate and the tones they're made of.
+            struct Clock{
+                float   tone,
+                        gap,
+                        spread;
+                size_t  observed;
+            };
+
+            size_t                sampleSize,
+                                  blockMs,
+                                  blockLen,
+                                  fill,
+                                  run,
+                                  toneBlocks,
+                                  holes,
+                                  idle;
+            uint64_t              position;
+            char                  candidate,
+                                  active;
+            bool                  emitted,
+                                  recovery;
+            Clock                 clock;
+            SymbolCallback        callback;
+            std::vector<float>    block;
+            std::array<float, DTMF_FREQS * 2>  coeff;
+            std::string           symbols,
+                                  errMsg;
+
+            void                  configure(size_t sSize)                       noexcept;
+            void                  push(float sample)                            noexcept;
+            void                  step(char sym)                                noexcept;
+            void                  emit(char sym)                                noexcept;
+            bool                  recovering(void)                      const   noexcept;
+            // A break of len blocks still ends before the current tone should.
+            bool                  canBridge(size_t len)                 const   noexcept;
+            // Symbols merged into the ending tone, past the first one.
+            size_t                countRepeats(void)                    const   noexcept;
+            void                  endTone(void)                                 noexcept;
+            char                  detect(const float* data)             const   noexcept;
+            // Start of the second of two tone free blocks at or after from, or SIZE_MAX.
+            size_t                findCut(const std::vector<float>& pcm,
+                                          size_t                    from)   const   noexcept;
+            void                  decodeParallel(const WavFileSource& src,
+                                                 size_t               channel,
+                                                 size_t               threads);
+    };
+
+    // Impairments applied by AutoTuner between the renderer and the decoder.
+    struct LinkModel{
+        float    noise;          // White noise RMS, full scale is 1.0
+        size_t   cutoff;         // Low-pass corner in Hz, 0 for none
+        float    drift;          // Speed error, 0.02 plays 2% fast
+
+        static LinkModel  fromName(const std::string& name);
+    };
+
+    constexpr LinkModel   LINK_CLEAN  { 0.0F, 0, 0.0F };
+
+    // Loopback search of the shortest timing profile decoded without errors:
+    // test payloads are rendered in memory, degraded by the link model and
+    // decoded, searching the tone length first and then the gap.
+    class AutoTuner{
+        public:
+            explicit             AutoTuner(const LinkModel& lnk    =  LINK_CLEAN,
+                                           size_t           sSize  =  8000,
+                                           SampleFormat     fmt    =  FORMAT_U8,
+                                           size_t           trials =  3);
+
+            // Symbols lost, added or changed over all the trials.
+            size_t               errors(const DtmfTiming& tm)           const;
+            // margin is added, in percent, to the minimums found.
+            bool                 tune(size_t margin = 20)                      noexcept;
+            const DtmfTiming&    getProfile(void)                       const  noexcept;
+            const DtmfTiming&    getMinimum(void)                       const  noexcept;
+            const std::string&   getErrMsg(void)                        const  noexcept;
+
+            static constexpr size_t  MIN_MS       { 5   };
+            static constexpr size_t  MAX_MS       { 250 };
+            static constexpr size_t  TEST_SYMBOLS { 64  };
+
+        private:
+            LinkModel             link;
+            size_t                sampleSize,
+                                  trials;
+            SampleFormat          format;
+            DtmfTiming            minimum,
+                                  profile;
+            std::string           errMsg;
+
+            void                  degrade(std::vector<float>& pcm,
+                                          size_t              seed)     const;
+    };
+
+    // FRAMING_FEC cuts the payload in FecFrame blocks, which the decoder
+    // repairs in place; FRAMING_NONE is the plain nibble stream.
+    enum Framing { FRAMING_NONE, FRAMING_FEC };
+
+    // A block of the FEC framing: header (sequence number, length, last flag),
+    // DATA payload bytes, CRC16 of both and PARITY Reed-Solomon bytes over
+    // GF(256), so up to PARITY / 2 wrong bytes are corrected. It's sent as
+    // SYMBOLS nibble symbols, high nibble first.
+    struct FecFrame{
+        static constexpr size_t  HEADER  { 6 };
+        static constexpr size_t  DATA    { 64 };
+        static constexpr size_t  PARITY  { 16 };
+        static constexpr size_t  BYTES   { HEADER + DATA + 2 + PARITY };
+        static constexpr size_t  SYMBOLS { BYTES * 2 };
+        static constexpr size_t  SLIP    { 4 };      // Symbols searched around a lost frame
+
+        uint32_t       seq;
+        size_t         length;
+        bool           last;
+        unsigned char  data[DATA];
+
+        void         encode(char* out)                                  const  noexcept;
+        // Symbols outside the alphabet count as wrong ones; corrected is the
+        // number of bytes repaired. False if the frame can't be recovered.
+        static bool  decode(const char* in, FecFrame& frame, size_t& corrected) noexcept;
+    };
+
+    // Dependency free compression of the payloads: LZ77 matches and literals
+    // coded by an adaptive binary range coder. Packed data is led by a HEADER:
+    // magic, length and CRC32 of the original data, so decoders detect it.
+    class Packer{
+        public:
+           static constexpr size_t  HEADER { 12 };
+
+           static void   pack(const unsigned char* in, size_t len,
+                              std::vector<unsigned char>& out);
+           // Packs in up to its end; inputs over 4 GB are rejected as they're read.
+           static void   packStream(std::istream& in, std::vector<unsigned char>& out);
+           static bool   isPacked(const unsigned char* in, size_t len)        noexcept;
+           // False if in isn't packed or it's corrupted.
+           static bool   unpack(const unsigned char* in, size_t len,
+                                std::vector<unsigned char>& out)             noexcept;
+    };
+
     class BinFileToDtmf{
         public:
-           explicit BinFileToDtmf(const std::string& fileName);
+           // compress packs the whole file before the encoding.
+           explicit BinFileToDtmf(const std::string& fileName, Framing frm=FRAMING_NONE,
+                                  bool compress=false);
            ~BinFileToDtmf(void);
 
-           bool saveTo(const std::string& outFile)                 const  noexcept;
+           // threads: 1 streams the file, more (0 for every core) converts
+           // chunks of a regular file in parallel; the FEC framing and the
+           // compression always stream.
+           bool          saveTo(const std::string& outFile,
+                                size_t threads=1)                  const  noexcept;
+           // Expands len bytes into 2 * len symbols, high nibble first.
+           static void   encode(const unsigned char* in, size_t len, char* out) noexcept;
+
+           static constexpr size_t  ENCODE_BLOCK { 1U << 16 };
 
         private:
+           const std::string             inName;
            std::ifstream                 iFile;
            mutable std::ofstream         oFile;
-           const std::array<char, 0x10>  binToDtmf;
+           Framing                       framing;
+           bool                          packed;
+           std::vector<unsigned char>    packBuff;
+           mutable size_t                packOff;
+
+           bool             saveParallel(const std::string& outFile, size_t threads) const  noexcept;
+           void             writeFec(std::ostream& out)                    const;
+           std::streamsize  read(char* buff, size_t len)                   const;
 
            friend std::ostream& operator<< (std::ostream& out, const BinFileToDtmf& ftd);
     };
@@ -109,7 +887,21 @@ namespace dtmfutil {
            ~BinFileToMT8870Dtmf(void);
 
            bool          saveTo(const std::string& outFile)                const  noexcept;
-           static bool   parity(char ch)                                          noexcept;
+           // Expands len bytes into FRAME_LEN * len symbols: three decimal digits,
+           // the parity code and the byte separator, each followed by 'D'.
+           static void   encode(const unsigned char* in, size_t len, char* out) noexcept;
+
+           static constexpr bool parity(char ch)                                  noexcept{
+                 int count { 0 };
+
+                 for(unsigned char bits { static_cast<unsigned char>(ch) }; bits != 0; bits >>= 1)
+                     count += bits & 0x01;
+
+                 return (count & 0x01) ? true : false;
+           }
+
+           static constexpr size_t  FRAME_LEN    { 10 };
+           static constexpr size_t  ENCODE_BLOCK { 1U << 14 };
 
         private:
            std::ifstream                 iFile;
@@ -119,21 +911,180 @@ namespace dtmfutil {
 
     };
 
+    // How DtmfToBinFile treats symbols outside the tone alphabet.
+    enum DecodeMode { DECODE_STRICT, DECODE_SKIP_SPACE, DECODE_SKIP_INVALID };
+
+    struct DecodeResult{
+        static constexpr size_t  NO_OFFSET { SIZE_MAX };
+
+        size_t       bytes;          // Decoded bytes
+        size_t       skipped;        // Symbols ignored by the skip modes
+        size_t       corrected;      // Bytes repaired by the FEC framing
+        size_t       errOffset;      // Input offset of the first bad symbol
+        std::string  errMsg;
+
+        bool ok(void)                                          const  noexcept{
+            return errOffset == NO_OFFSET && errMsg.empty();
+        }
+    };
+
+    // Inverse of BinFileToMT8870Dtmf. DECODE_SKIP_INVALID drops corrupted frames
+    // (bad digits, value or parity code) and counts them in skipped.
+    class MT8870DtmfToBinFile{
+        public:
+           explicit MT8870DtmfToBinFile(const std::string& fileName, DecodeMode dMode=DECODE_STRICT);
+           ~MT8870DtmfToBinFile(void);
+
+           bool                 saveTo(const std::string& outFile)      const  noexcept;
+           const DecodeResult&  getResult(void)                         const  noexcept;
+           // Decodes consecutive well-formed frames, stopping before the first
+           // one that isn't; returns the number of symbols used.
+           static size_t        decode(const char* in, size_t len, unsigned char* out) noexcept;
+
+           static constexpr size_t  DECODE_BLOCK { 1U << 17 };
+
+        private:
+           std::ifstream                 iFile;
+           mutable std::ofstream         oFile;
+           DecodeMode                    mode;
+           mutable DecodeResult          result;
+
+           friend std::ostream& operator<< (std::ostream& out, const MT8870DtmfToBinFile& dtf);
+    };
+
     class DtmfToBinFile{
         public:
-           explicit DtmfToBinFile(const std::string& fileName);
+           explicit DtmfToBinFile(const std::string& fileName, DecodeMode dMode=DECODE_STRICT,
+                                  Framing frm=FRAMING_NONE);
            ~DtmfToBinFile(void);
 
-           bool saveTo(const std::string& outFile)             const  noexcept;
+           // threads as in BinFileToDtmf::saveTo; the skip modes always stream.
+           // With the FEC framing the skip modes drop whitespace only, other
+           // symbols outside the alphabet are corrected as wrong ones.
+           // Packer data is detected and unpacked in outFile; data whose
+           // header or CRC doesn't check out is a plain file, kept as it is.
+           bool                 saveTo(const std::string& outFile,
+                                       size_t threads=1)                const  noexcept;
+           const DecodeResult&  getResult(void)                         const  noexcept;
+           // Packs symbol pairs into out, stopping before the first pair holding
+           // a symbol outside the alphabet; returns the number of symbols used.
+           static size_t        decode(const char* in, size_t len, unsigned char* out) noexcept;
+           static int           symbolValue(char ch)                          noexcept;
+
+           static constexpr size_t  DECODE_BLOCK { 1U << 17 };
 
         private:
+           const std::string             inName;
            std::ifstream                 iFile;
            mutable std::ofstream         oFile;
-           const std::map<char, uint8_t> dtmfToBin;
+           DecodeMode                    mode;
+           Framing                       framing;
+           mutable DecodeResult          result;
+
+           bool                 saveParallel(const std::string& outFile, size_t threads) const  noexcept;
+           void                 readFec(std::ostream& out)              const  noexcept;
+           bool                 unpackTo(const std::string& outFile)    const;
 
            friend std::ostream& operator<< (std::ostream& out, const DtmfToBinFile& ftd);
     };
 
+    // Decodes a live source a period at a time: the symbols are paired into
+    // bytes as by DtmfToBinFile, written as soon as they're complete.
+    class DtmfReceiver{
+        public:
+           explicit DtmfReceiver(std::shared_ptr<AudioSource> src,
+                                 size_t                       blockMs  =  10);
+
+           // Called for every symbol, before its byte is written.
+           void                 setCallback(SymbolCallback cb)                  noexcept;
+           // Reads until the end of the source, stop() or an error.
+           bool                 run(std::ostream& out)                          noexcept;
+           // Safe from a signal handler or another thread.
+           void                 stop(void)                                      noexcept;
+
+           uint64_t             getSymbols(void)                        const  noexcept;
+           uint64_t             getBytes(void)                          const  noexcept;
+           // A symbol left over at the end, waiting for its pair.
+           bool                 hasPending(void)                        const  noexcept;
+           const std::string&   getErrMsg(void)                         const  noexcept;
+
+        private:
+           std::shared_ptr<AudioSource>  source;
+           DtmfDecoder                   decoder;
+           SymbolCallback                callback;
+           std::atomic<bool>             stopping;
+           int                           pending;
+           uint64_t                      symbols,
+                                         bytes;
+           std::string                   errMsg;
+    };
+
+    // Leads every lane stream: lane index, lane count and length of the whole
+    // payload, in the plain nibble encoding, followed by a check byte.
+    struct LaneHeader{
+        static constexpr size_t  BYTES     { 7 };
+        static constexpr size_t  SYMBOLS   { BYTES * 2 };
+        static constexpr size_t  MAX_LANES { 0xFF };
+
+        size_t       lane,
+                     lanes;
+        uint32_t     length;
+
+        void         encode(char* out)                                  const  noexcept;
+        static bool  decode(const char* in, size_t len, LaneHeader& hdr)       noexcept;
+    };
+
+    // Stripes a payload byte by byte over every channel of its sinks, in sink
+    // order: each sink is driven by its own thread, so several devices (or
+    // radios) transmit in parallel. Sinks share format and sample rate.
+    class LaneTransmitter{
+        public:
+            LaneTransmitter(std::vector<std::shared_ptr<AudioSink>> snks,
+                            const DtmfTiming& tm,
+                            size_t            sSize    =  8000,
+                            bool              whsound  =  true);
+
+            bool                 send(const unsigned char* data,
+                                      size_t               len)         const  noexcept;
+            bool                 sendFile(const std::string& fileName)  const  noexcept;
+            size_t               getLanes(void)                         const  noexcept;
+            const std::string&   getErrMsg(void)                        const  noexcept;
+
+            // Symbol streams of the lanes, header first.
+            static std::vector<std::string>  split(const unsigned char* data,
+                                                   size_t               len,
+                                                   size_t               lanes);
+
+        private:
+            std::vector<std::shared_ptr<AudioSink>>  sinks;
+            std::shared_ptr<const ToneBank>          bank;
+            size_t                                   lanes;
+            bool                                     whiteSound;
+            mutable std::string                      errMsg;
+    };
+
+    // Receiving side: lane streams are added in any order, the headers tell
+    // where their bytes go.
+    class LaneReassembler{
+        public:
+            LaneReassembler(void)                                                   noexcept;
+
+            bool                 add(const std::string& symbols)                noexcept;
+            bool                 addFile(const std::string& fileName)           noexcept;
+            bool                 complete(void)                         const  noexcept;
+            bool                 assemble(std::vector<unsigned char>& out) const  noexcept;
+            // Packer data is unpacked, as in DtmfToBinFile::saveTo.
+            bool                 saveTo(const std::string& outFile)     const  noexcept;
+            const std::string&   getErrMsg(void)                        const  noexcept;
+
+        private:
+            LaneHeader                               header;
+            std::vector<std::vector<unsigned char>>  payloads;
+            std::vector<bool>                        received;
+            size_t                                   count;
+            mutable std::string                      errMsg;
+    };
+
 } // End Namespace
 
 #endif
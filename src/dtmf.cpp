@@ -18,28 +18,58 @@
 
 #include <dtmf.hpp>
 #include <cmath>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
 
 namespace dtmfutil {
 
-    using std::make_pair;
-    using std::make_tuple;
-    using std::get;
     using std::vector;
     using std::array;
     using std::string;
     using std::to_string;
     using std::endl;
-    using std::toupper;
     using std::ios;
     using std::hex;
     using std::setw;
     using std::setfill;
     using std::ostream;
     using std::ofstream;
+    using std::ifstream;
     using std::istream;
     using std::istreambuf_iterator;
     using std::array;
-    using std::out_of_range;
+
+    namespace {
+
+        constexpr SineTable                       sineTable;
+
+        // Banks for the named profiles at the default rate, built by the compiler.
+        constexpr StaticToneBank<8000, 250>       bankClassic;
+        constexpr StaticToneBank<8000, 100>       bankFast;
+        constexpr StaticToneBank<8000, 40>        bankItu;
+
+        const unsigned char* staticTone(char sym, size_t sSize, size_t tlen) noexcept{
+            if(sSize != 8000)
+                return nullptr;
+
+            for(size_t row{ 0 }; row < DTMF_FREQS; ++row){
+                for(size_t col{ 0 }; col < DTMF_FREQS; ++col){
+                    if(dtmfKeypad[row][col] != sym)
+                        continue;
+                    switch(tlen){
+                        case 250:  return bankClassic.tone(row, col);
+                        case 100:  return bankFast.tone(row, col);
+                        case 40:   return bankItu.tone(row, col);
+                        default:   return nullptr;
+                    }
+                }
+            }
+
+            return nullptr;
+        }
+
+    } // End Anonymous Namespace
 
     istream& operator>> (istream& in, const Dtmf& dtmf){
         for( istreambuf_iterator<char> it(in.rdbuf()); it != istreambuf_iterator<char>(); ++it)
@@ -49,133 +79,358 @@ namespace dtmfutil {
     }
 
     ostream& operator<< (ostream& out, const DtmfToBinFile& dtf){
+        if(dtf.framing == FRAMING_FEC){
+            dtf.readFec(out);
+            return out;
+        }
+
+        DecodeResult&  res     { dtf.result };
+        int            pending { -1 };
+        size_t         offset  { 0 },
+                       pendOff { 0 };
+
+        res  =  DecodeResult{ 0, 0, 0, DecodeResult::NO_OFFSET, "" };
+
         try{
-            uint8_t lower{ 0x0 },
-                    upper{ 0x0 },
-                    merge{ 0x0 };
-            size_t  ch{ 1 };
-
-            for( istreambuf_iterator<char> it(dtf.iFile.rdbuf());
-                 it != istreambuf_iterator<char>();
-                 ++it, ++ch){
-                     if( (ch % 2) != 0){
-                         upper  =  dtf.dtmfToBin.at(*it) << 4;
-                     }else{
-                         merge  =  0x0;
-                         lower  =  dtf.dtmfToBin.at(*it);
-                         merge  =  merge | lower | upper;
-                         out    << merge;
+            vector<char>           inBuff(DtmfToBinFile::DECODE_BLOCK);
+            vector<unsigned char>  outBuff(DtmfToBinFile::DECODE_BLOCK / 2 + 1);
+
+            for(std::streamsize len { dtf.iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size()) };
+                len > 0 && res.ok();
+                offset += static_cast<size_t>(len),
+                len = dtf.iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size())){
+                     const char*     in   { inBuff.data() };
+                     const size_t    end  { static_cast<size_t>(len) };
+                     unsigned char*  dest { outBuff.data() };
+
+                     for(size_t pos{ 0 }; pos < end; ){
+                         if(pending < 0){
+                             const size_t used { DtmfToBinFile::decode(in + pos, end - pos, dest) };
+                             pos   +=  used;
+                             dest  +=  used / 2;
+                             if(pos == end) break;
+                         }
+
+                         // A single symbol left over, or one outside the alphabet.
+                         const int  val { DtmfToBinFile::symbolValue(in[pos]) };
+                         if(val >= 0){
+                             if(pending < 0){
+                                 pending  =  val;
+                                 pendOff  =  offset + pos;
+                             }else{
+                                 *dest++  =  static_cast<unsigned char>(pending << 4 | val);
+                                 pending  =  -1;
+                             }
+                         }else if(dtf.mode == DECODE_SKIP_INVALID ||
+                                  (dtf.mode == DECODE_SKIP_SPACE && std::isspace(static_cast<unsigned char>(in[pos])))){
+                             ++res.skipped;
+                         }else{
+                             res.errOffset  =  offset + pos;
+                             res.errMsg     =  string("Dtmf decoding: Invalid value at offset: ")
+                                               .append(to_string(res.errOffset));
+                             break;
+                         }
+                         ++pos;
                      }
-            }
 
-            if( (ch % 2) != 0)
-                 throw string("Dtmf decoding: Invalid trailing character");
+                     const size_t  outLen { static_cast<size_t>(dest - outBuff.data()) };
+                     out.write(reinterpret_cast<const char*>(outBuff.data()), outLen);
+                     res.bytes  +=  outLen;
+            }
 
-        }catch(out_of_range& err){
-                 static_cast<void>(err);
-                 throw string("Dtmf decoding: Invalid value.");
+            if(res.ok() && pending >= 0){
+                res.errOffset  =  pendOff;
+                res.errMsg     =  string("Dtmf decoding: Invalid trailing character at offset: ")
+                                  .append(to_string(pendOff));
+            }
         }catch(...){
-                 throw string("Dtmf decoding: Unexpected Error.");
+            res.errMsg  =  "Dtmf decoding: Unexpected Error.";
         }
 
-        return out; 
+        if(!res.ok())
+            out.setstate(ios::failbit);
+
+        return out;
     }
 
-    ostream& operator<< (ostream& out, const BinFileToMT8870Dtmf& dtf){
+    ostream& operator<< (ostream& out, const MT8870DtmfToBinFile& dtf){
+        DecodeResult&  res      { dtf.result };
+        char           digits[4];
+        size_t         count    { 0 },
+                       offset   { 0 },
+                       frameOff { 0 };
+        bool           inFrame  { false },
+                       corrupt  { false },
+                       done     { false };
+
+        res  =  DecodeResult{ 0, 0, 0, DecodeResult::NO_OFFSET, "" };
+
         try{
-            string       buff,
-                         parityString;
-            const char   digitSep   { 'D' },
-                         byteSep    { 'B' },
-                         endMsg     { '#' };
-            const size_t MAX_DIGIT  { 3 };
-            array<unsigned char, MAX_DIGIT> parityCount{0b00000001, 0b00000010, 0b00000100};
-
-            for( istreambuf_iterator<char> it(dtf.iFile.rdbuf());
-                 it != istreambuf_iterator<char>();
-                 ++it){
-                    buff = to_string(*it);
-                    if(buff.size() == 1)
-                        buff.insert (0, "00");
-                    if(buff.size() == 2)
-                        buff.insert (0, 1, '0');
-
-                    size_t pos { 0 };
-                    unsigned char parityCode { 0 };
-                    for(auto itt { buff.begin() }; itt != buff.end(); ++itt, ++pos){
-                        out    << *itt;
-                        out    << digitSep;
-                        if(BinFileToMT8870Dtmf::parity(*itt)) 
-                            parityCode += parityCount.at(pos);
-                    }
+            vector<char>           inBuff(MT8870DtmfToBinFile::DECODE_BLOCK);
+            vector<unsigned char>  outBuff(MT8870DtmfToBinFile::DECODE_BLOCK / BinFileToMT8870Dtmf::FRAME_LEN + 1);
+
+            for(std::streamsize len { dtf.iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size()) };
+                len > 0 && res.ok() && !done;
+                offset += static_cast<size_t>(len),
+                len = dtf.iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size())){
+                     const char*     in   { inBuff.data() };
+                     const size_t    end  { static_cast<size_t>(len) };
+                     unsigned char*  dest { outBuff.data() };
+
+                     // A frame closed by 'B' is kept only if it holds three digits
+                     // and the parity code computed from them.
+                     auto closeFrame { [&](void){
+                         unsigned  code { 0 },
+                                   val  { 0 };
+                         for(size_t pos{ 0 }; pos < 3 && pos < count; ++pos){
+                             val   =  val * 10 + static_cast<unsigned>(digits[pos] - '0');
+                             code +=  BinFileToMT8870Dtmf::parity(digits[pos]) ? 1U << pos : 0;
+                         }
+                         if(!corrupt && count == 4 && val <= 0xFF &&
+                            static_cast<unsigned>(digits[3] - '0') == code){
+                             *dest++  =  static_cast<unsigned char>(val);
+                         }else if(dtf.mode != DECODE_SKIP_INVALID){
+                             res.errOffset  =  frameOff;
+                             res.errMsg     =  string("MT8870 decoding: Corrupted frame at offset: ")
+                                               .append(to_string(frameOff));
+                         }else{
+                             ++res.skipped;
+                         }
+                         count    =  0;
+                         inFrame  =  false;
+                         corrupt  =  false;
+                     } };
+
+                     for(size_t pos{ 0 }; pos < end && res.ok() && !done; ++pos){
+                         if(!inFrame){
+                             const size_t used { MT8870DtmfToBinFile::decode(in + pos, end - pos, dest) };
+                             pos   +=  used;
+                             dest  +=  used / BinFileToMT8870Dtmf::FRAME_LEN;
+                             if(pos == end) break;
+                         }
+
+                         const char  ch { in[pos] };
+                         if(dtf.mode != DECODE_STRICT && std::isspace(static_cast<unsigned char>(ch)))
+                             continue;
+                         if(!inFrame && ch == 'D')
+                             continue;
+                         if(!inFrame && ch == '#'){
+                             done  =  true;
+                             break;
+                         }
+                         if(!inFrame){
+                             inFrame   =  true;
+                             frameOff  =  offset + pos;
+                         }
+
+                         if(ch >= '0' && ch <= '9' && count < 4)
+                             digits[count++]  =  ch;
+                         else if(ch == 'B' || ch == '#')
+                             closeFrame();
+                         else if(ch != 'D')
+                             corrupt  =  true;
+
+                         if(ch == '#')
+                             done  =  true;
+                     }
 
-                    parityString = to_string(parityCode);
-                    out    << parityString.at(0);
-                    out    << digitSep;
+                     const size_t  outLen { static_cast<size_t>(dest - outBuff.data()) };
+                     out.write(reinterpret_cast<const char*>(outBuff.data()), outLen);
+                     res.bytes  +=  outLen;
+            }
 
-                    out    << byteSep;
-                    out    << digitSep;
+            if(res.ok() && inFrame){
+                if(dtf.mode != DECODE_SKIP_INVALID){
+                    res.errOffset  =  frameOff;
+                    res.errMsg     =  string("MT8870 decoding: Truncated frame at offset: ")
+                                      .append(to_string(frameOff));
+                }else{
+                    ++res.skipped;
+                }
             }
+        }catch(...){
+            res.errMsg  =  "MT8870 decoding: Unexpected Error.";
+        }
 
-            out    <<  endMsg;
-            out    <<  digitSep;
+        if(!res.ok())
+            out.setstate(ios::failbit);
 
-        }catch(...){
-                 throw string("Dtmf encoding: Unexpected Error.");
+        return out;
+    }
+
+    ostream& operator<< (ostream& out, const BinFileToMT8870Dtmf& dtf){
+        vector<char>  inBuff(BinFileToMT8870Dtmf::ENCODE_BLOCK),
+                      outBuff(BinFileToMT8870Dtmf::ENCODE_BLOCK * BinFileToMT8870Dtmf::FRAME_LEN);
+
+        for(std::streamsize len { dtf.iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size()) };
+            len > 0;
+            len = dtf.iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size())){
+                 BinFileToMT8870Dtmf::encode(reinterpret_cast<const unsigned char*>(inBuff.data()),
+                                             static_cast<size_t>(len), outBuff.data());
+                 out.write(outBuff.data(), len * BinFileToMT8870Dtmf::FRAME_LEN);
         }
 
+        out.write("#D", 2);
+
         return out;
     }
 
     ostream& operator<< (ostream& out, const BinFileToDtmf& ftd){
-        for( istreambuf_iterator<char> it(ftd.iFile.rdbuf());
-             it != istreambuf_iterator<char>();
-             ++it){
-                 unsigned char lower  { static_cast<unsigned char>(*it & 0b0000'1111 ) },
-                               upper  { static_cast<unsigned char>((*it & 0b1111'0000 ) >> 4 ) };
-                 out    << ftd.binToDtmf[upper];
-                 out    << ftd.binToDtmf[lower];
+        if(ftd.framing == FRAMING_FEC){
+            ftd.writeFec(out);
+            return out;
+        }
+
+        vector<char>  inBuff(BinFileToDtmf::ENCODE_BLOCK),
+                      outBuff(BinFileToDtmf::ENCODE_BLOCK * 2);
+
+        for(std::streamsize len { ftd.read(inBuff.data(), inBuff.size()) };
+            len > 0;
+            len = ftd.read(inBuff.data(), inBuff.size())){
+                 BinFileToDtmf::encode(reinterpret_cast<const unsigned char*>(inBuff.data()),
+                                       static_cast<size_t>(len), outBuff.data());
+                 out.write(outBuff.data(), len * 2);
         }
 
         return out;
     }
 
-    DtmfToBinFile::DtmfToBinFile(const std::string& fileName)
-       : iFile(fileName, ios::in | ios::binary),
-         dtmfToBin { {'0', 0x0 }, {'1', 0x1 }, {'2', 0x2 }, {'3', 0x3 },
-                     {'4', 0x4 }, {'5', 0x5 }, {'6', 0x6 }, {'7', 0x7 },
-                     {'8', 0x8 }, {'9', 0x9 }, {'A', 0xA }, {'B', 0xB },
-                     {'C', 0xC }, {'D', 0xD }, {'#', 0xE }, {'*', 0xF }  }
+    DtmfToBinFile::DtmfToBinFile(const std::string& fileName, DecodeMode dMode, Framing frm)
+       : inName{ fileName },
+         iFile(fileName, ios::in | ios::binary),
+         mode{ dMode },
+         framing{ frm },
+         result{ 0, 0, 0, DecodeResult::NO_OFFSET, "" }
     {}
 
     DtmfToBinFile::~DtmfToBinFile(void){
            iFile.close();
     }
 
-    bool DtmfToBinFile::saveTo(const string& outFile) const noexcept{
-        bool ret{ true };
+    bool DtmfToBinFile::saveTo(const string& outFile, size_t threads) const noexcept{
         try{
-            oFile.open (outFile, ofstream::out);
+            if(!iFile.is_open()){
+                result.errMsg  =  "DtmfToBinFile::saveTo : can't open the tone file.";
+                return false;
+            }
+            if(threads != 1 && mode == DECODE_STRICT && framing == FRAMING_NONE)
+                return saveParallel(outFile, threads) && unpackTo(outFile);
+            oFile.open (outFile, ofstream::out | ofstream::binary);
+            if(!oFile.is_open()){
+                result.errMsg  =  string("DtmfToBinFile::saveTo : can't open file: ").append(outFile);
+                return false;
+            }
             oFile << *this;
             oFile.close();
+            if(result.ok() && !oFile)
+                result.errMsg  =  "DtmfToBinFile::saveTo : write failed.";
+            if(result.ok())
+                unpackTo(outFile);
         }catch(...){
-            ret  =  false;
+            result.errMsg  =  "DtmfToBinFile::saveTo : Unexpected Error.";
         }
 
-        return ret;
+        return result.ok();
     }
 
-    BinFileToDtmf::BinFileToDtmf(const std::string& fileName)
+    bool DtmfToBinFile::unpackTo(const string& outFile) const{
+        ifstream  iData(outFile, ios::in | ios::binary);
+        char      magic[Packer::HEADER];
+        if(!iData.read(magic, sizeof(magic)) ||
+           !Packer::isPacked(reinterpret_cast<const unsigned char*>(magic), sizeof(magic)))
+            return true;
+
+        iData.seekg(0);
+        const vector<unsigned char>  data { istreambuf_iterator<char>(iData),
+                                            istreambuf_iterator<char>() };
+        vector<unsigned char>        plain;
+        iData.close();
+        // Only the magic matched: a plain file starting with the same bytes.
+        if(!Packer::unpack(data.data(), data.size(), plain))
+            return true;
+
+        oFile.open(outFile, ofstream::out | ofstream::binary | ofstream::trunc);
+        oFile.write(reinterpret_cast<const char*>(plain.data()), plain.size());
+        oFile.close();
+        if(!oFile){
+            result.errMsg  =  "DtmfToBinFile::saveTo : write failed.";
+            return false;
+        }
+        result.bytes  =  plain.size();
+
+        return true;
+    }
+
+    const DecodeResult& DtmfToBinFile::getResult(void) const noexcept{
+          return result;
+    }
+
+    MT8870DtmfToBinFile::MT8870DtmfToBinFile(const std::string& fileName, DecodeMode dMode)
        : iFile(fileName, ios::in | ios::binary),
-         binToDtmf { '0', '1', '2', '3', '4', '5', '6', '7',
-                     '8', '9', 'A', 'B', 'C', 'D', '#', '*'  }
+         mode{ dMode },
+         result{ 0, 0, 0, DecodeResult::NO_OFFSET, "" }
     {}
 
+    MT8870DtmfToBinFile::~MT8870DtmfToBinFile(void){
+           iFile.close();
+    }
+
+    bool MT8870DtmfToBinFile::saveTo(const string& outFile) const noexcept{
+        try{
+            if(!iFile.is_open()){
+                result.errMsg  =  "MT8870DtmfToBinFile::saveTo : can't open the tone file.";
+                return false;
+            }
+            oFile.open (outFile, ofstream::out | ofstream::binary);
+            if(!oFile.is_open()){
+                result.errMsg  =  string("MT8870DtmfToBinFile::saveTo : can't open file: ").append(outFile);
+                return false;
+            }
+            oFile << *this;
+            oFile.close();
+            if(result.ok() && !oFile)
+                result.errMsg  =  "MT8870DtmfToBinFile::saveTo : write failed.";
+        }catch(...){
+            result.errMsg  =  "MT8870DtmfToBinFile::saveTo : Unexpected Error.";
+        }
+
+        return result.ok();
+    }
+
+    const DecodeResult& MT8870DtmfToBinFile::getResult(void) const noexcept{
+          return result;
+    }
+
+    BinFileToDtmf::BinFileToDtmf(const std::string& fileName, Framing frm, bool compress)
+       : inName{ fileName },
+         iFile(fileName, ios::in | ios::binary),
+         framing{ frm },
+         packed{ compress && iFile.is_open() },
+         packOff{ 0 }
+    {
+        if(packed)
+            Packer::packStream(iFile, packBuff);
+    }
+
     BinFileToDtmf::~BinFileToDtmf(void){
            iFile.close();
     }
 
-    bool BinFileToDtmf::saveTo(const string& outFile) const noexcept{
+    std::streamsize BinFileToDtmf::read(char* buff, size_t len) const{
+        if(!packed)
+            return iFile.rdbuf()->sgetn(buff, static_cast<std::streamsize>(len));
+
+        const size_t  count { std::min(len, packBuff.size() - packOff) };
+        std::copy(packBuff.data() + packOff, packBuff.data() + packOff + count, buff);
+        packOff  +=  count;
+
+        return static_cast<std::streamsize>(count);
+    }
+
+    bool BinFileToDtmf::saveTo(const string& outFile, size_t threads) const noexcept{
+        if(threads != 1 && framing == FRAMING_NONE && !packed)
+            return saveParallel(outFile, threads);
+
         bool ret{ true };
         try{
             oFile.open (outFile, ofstream::out);
@@ -196,21 +451,6 @@ namespace dtmfutil {
            iFile.close();
     }
 
-    bool BinFileToMT8870Dtmf::parity(char ch) noexcept{
-          int count { 0 };
-
-          if(ch & 0x01) count++;
-          if(ch & 0x02) count++;
-          if(ch & 0x04) count++;
-          if(ch & 0x08) count++;
-          if(ch & 0x10) count++;
-          if(ch & 0x20) count++;
-          if(ch & 0x40) count++;
-          if(ch & 0x80) count++;
-
-          return (count & 0x01) ? true : false;
-    }
-
     bool BinFileToMT8870Dtmf::saveTo(const string& outFile) const noexcept{
         bool ret{ true };
         try{
@@ -224,162 +464,448 @@ namespace dtmfutil {
         return ret;
     }
 
-    AlsaPlay::AlsaPlay(size_t sSize, string dev)
-     : handle{ nullptr },
-       frames{ 0 },
+    constexpr size_t  ToneBank::ALIGNMENT;
+
+    ToneBank::ToneBank(size_t sSize, const DtmfTiming& tm, size_t tlen, SampleFormat fmt)
+     : base{ nullptr },
+       sampleSize{ sSize },
+       toneLen{ (tlen * sSize) / 1000 },
+       toneMs{ tlen },
+       arenaSize{ 0 },
+       format{ fmt },
+       timing(tm)
+    {
+        const size_t  bytes     { sampleBytes(format) },
+                      gapLen    { ((tm.gapMs   * sSize) / 1000) * bytes },
+                      pauseLen  { ((tm.pauseMs * sSize) / 1000) * bytes };
+        auto          aligned   { [](size_t len){ return (len + ALIGNMENT - 1) & ~(ALIGNMENT - 1); } };
+        const size_t  toneSpan  { aligned(toneLen * bytes) },
+                      total     { toneSpan * DTMF_FREQS * DTMF_FREQS + aligned(gapLen) + aligned(pauseLen) };
+
+        if(total > NO_TONE)
+            throw string("ToneBank::ToneBank : tones too long.");
+        arenaSize  =  total;
+
+        void*  mem { nullptr };
+        if(posix_memalign(&mem, ALIGNMENT, std::max<size_t>(total, ALIGNMENT)) != 0)
+            throw string("ToneBank::ToneBank : can't allocate the tone arena.");
+        storage.reset(static_cast<unsigned char*>(mem), free);
+        base  =  storage.get();
+
+        unsigned char* arena { storage.get() };
+        vector<float>  wave(format == FORMAT_U8 ? 0 : toneLen);
+        index.fill(ToneSlot{ NO_TONE, 0 });
+
+        for(size_t row{ 0 }; row < DTMF_FREQS; ++row){
+            for(size_t col{ 0 }; col < DTMF_FREQS; ++col){
+                const char           sym    { dtmfKeypad[row][col] };
+                const uint32_t       offset { static_cast<uint32_t>((row * DTMF_FREQS + col) * toneSpan) };
+                const unsigned char* pre    { format == FORMAT_U8 ? staticTone(sym, sampleSize, tlen) : nullptr };
+
+                if(pre != nullptr){
+                    std::copy(pre, pre + toneLen, arena + offset);
+                }else if(format == FORMAT_U8){
+                    sineTable.synth(dtmfColFreq[col], dtmfRowFreq[row], sampleSize, toneLen, arena + offset);
+                }else{
+                    sineTable.synth(dtmfColFreq[col], dtmfRowFreq[row], sampleSize, toneLen, wave.data());
+                    convertSamples(wave.data(), toneLen, format, arena + offset);
+                }
+
+                index[static_cast<unsigned char>(sym)] = ToneSlot{ offset, static_cast<uint32_t>(toneLen * bytes) };
+                if(std::isalpha(static_cast<unsigned char>(sym)))
+                    index[static_cast<unsigned char>(std::tolower(sym))] = index[static_cast<unsigned char>(sym)];
+            }
+        }
+
+        gapSlot  =  ToneSlot{ static_cast<uint32_t>(toneSpan * DTMF_FREQS * DTMF_FREQS),
+                              static_cast<uint32_t>(gapLen) };
+        index[static_cast<unsigned char>(' ')] = ToneSlot{ static_cast<uint32_t>(gapSlot.offset + aligned(gapLen)),
+                                                           static_cast<uint32_t>(pauseLen) };
+        // Silence is the mid level: 0x80 for unsigned samples, zero otherwise.
+        std::fill(arena + gapSlot.offset, arena + total, format == FORMAT_U8 ? 0x80 : 0);
+    }
+
+    size_t ToneBank::getSampleSize(void) const noexcept{
+        return sampleSize;
+    }
+
+    size_t ToneBank::getToneLen(void) const noexcept{
+        return toneLen;
+    }
+
+    size_t ToneBank::getToneMs(void) const noexcept{
+        return toneMs;
+    }
+
+    SampleFormat ToneBank::getFormat(void) const noexcept{
+        return format;
+    }
+
+    const DtmfTiming& ToneBank::getTiming(void) const noexcept{
+        return timing;
+    }
+
+    AlsaPlay::AlsaPlay(size_t sSize, string dev, SampleFormat fmt, size_t chans)
+     : AudioSink(fmt, chans),
+       handle{ nullptr },
        device{ dev },
-       sampleSize{ sSize }
+       sampleSize{ sSize },
+       writeSize{ sSize / 4 },
+       periodFrames{ sSize / 4 },
+       frameBytes{ sampleBytes(fmt) * channels }
     {
         int err{ 0 };
         if((err = snd_pcm_open(&handle, device.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
             throw string("AlsaPlay::AlsaPlay : can't open pcm : ").append(snd_strerror(err));
         }
 
+        const snd_pcm_format_t pcmFormat { format == FORMAT_U8     ? SND_PCM_FORMAT_U8     :
+                                           format == FORMAT_S16_LE ? SND_PCM_FORMAT_S16_LE :
+                                                                     SND_PCM_FORMAT_FLOAT_LE };
         if((err = snd_pcm_set_params(handle,
-                            SND_PCM_FORMAT_U8,
+                            pcmFormat,
                             SND_PCM_ACCESS_RW_INTERLEAVED,
-                            1,
+                            static_cast<unsigned int>(channels),
                             sampleSize,
                             1,
                             249999)) < 0) {
             throw string("AlsaPlay::AlsaPlay : can't set pcm : ").append(snd_strerror(err));
         }
+
+        snd_pcm_uframes_t  bufferSize { 0 },
+                           periodSize { 0 };
+        if(snd_pcm_get_params(handle, &bufferSize, &periodSize) == 0 && periodSize > 0){
+            writeSize     =  std::max<size_t>((bufferSize / periodSize) * periodSize, periodSize);
+            periodFrames  =  periodSize;
+        }
+    }
+
+    size_t AlsaPlay::getPeriod(void) const noexcept{
+        return periodFrames;
+    }
+
+    PlayStats AlsaPlay::getStats(void) const noexcept{
+        return counters.snapshot();
     }
 
     AlsaPlay::~AlsaPlay(void){
+        async.reset();
         snd_pcm_drain(handle);
         snd_pcm_close(handle);
     }
 
-    bool AlsaPlay::play(const RawSoundArray& arr, string& errmsg) const noexcept{
-        frames = snd_pcm_writei(handle, arr.data(), arr.size());
-        if (frames < 0){
-            frames = snd_pcm_recover(handle, frames, 0);
-            errmsg = string("snd_pcm_writei failed: ").append(snd_strerror(frames));
-            return false;
+    size_t AlsaPlay::nativeRate(const string& dev){
+        // Rates tried in order with the ALSA resampler disabled: the first one
+        // accepted is generated directly, so the plug layer has nothing to convert.
+        static constexpr unsigned int rates[] { 48000, 44100, 96000, 32000, 22050, 16000, 11025, 8000 };
+
+        snd_pcm_t*            pcm    { nullptr };
+        snd_pcm_hw_params_t*  params { nullptr };
+        size_t                ret    { 0 };
+        int                   err    { 0 };
+
+        if((err = snd_pcm_open(&pcm, dev.c_str(), SND_PCM_STREAM_PLAYBACK, 0)) < 0)
+            throw string("AlsaPlay::nativeRate : can't open pcm : ").append(snd_strerror(err));
+
+        if(snd_pcm_hw_params_malloc(&params) == 0){
+            if(snd_pcm_hw_params_any(pcm, params) >= 0 &&
+               snd_pcm_hw_params_set_rate_resample(pcm, params, 0) >= 0){
+                for(unsigned int rate : rates){
+                    if(snd_pcm_hw_params_test_rate(pcm, params, rate, 0) == 0){
+                        ret  =  rate;
+                        break;
+                    }
+                }
+                unsigned int maxRate { 0 };
+                if(ret == 0 && snd_pcm_hw_params_get_rate_max(params, &maxRate, nullptr) == 0)
+                    ret  =  maxRate;
+            }
+            snd_pcm_hw_params_free(params);
         }
-        if(static_cast<size_t>(frames) < arr.size()){
-            errmsg = string("Short write (expected: ").append(to_string(arr.size()))\
-                           .append(" wrote: ").append(to_string(frames));
+        snd_pcm_close(pcm);
+
+        if(ret == 0)
+            throw string("AlsaPlay::nativeRate : can't query the rate of: ").append(dev);
+
+        return ret;
+    }
+
+    bool AlsaPlay::play(const unsigned char* data, size_t len, string& errmsg) const noexcept{
+        // Once submit() was used the playback thread owns the pcm: queue and wait.
+        std::unique_lock<std::mutex>  guard(asyncLock);
+        if(async){
+            guard.unlock();
+            try{
+                const PlayHandle  job { submit(RawSoundArray(data, data + len)) };
+                if(job.wait() == PLAY_DONE)
+                    return true;
+                errmsg  =  job.getErrMsg().empty() ? string("AlsaPlay::play : playback cancelled.") : job.getErrMsg();
+            }catch(string& err){
+                errmsg  =  err;
+            }catch(...){
+                errmsg  =  "AlsaPlay::play : Unexpected Error.";
+            }
             return false;
         }
+
+        len  /=  frameBytes;
+
+        // Large writes, multiple of the period: one syscall per buffer instead of one per tone.
+        for(size_t done{ 0 }; done < len; ){
+            const size_t       chunk  { std::min(len - done, writeSize) };
+            const auto         start  { std::chrono::steady_clock::now() };
+            snd_pcm_sframes_t  frames { snd_pcm_writei(handle, data + done * frameBytes, chunk) };
+            counters.write(chunk, frames, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                              std::chrono::steady_clock::now() - start).count()));
+            if (frames < 0){
+                frames = snd_pcm_recover(handle, frames, 0);
+                if(frames < 0){
+                    counters.failure();
+                    errmsg = string("snd_pcm_writei failed: ").append(snd_strerror(frames));
+                    return false;
+                }
+                counters.xrun();
+                continue;
+            }
+            if(frames == 0){
+                counters.failure();
+                errmsg = string("Short write (expected: ").append(to_string(len))\
+                               .append(" wrote: ").append(to_string(done));
+                return false;
+            }
+            done += static_cast<size_t>(frames);
+        }
         return true;
     }
 
+    DtmfTiming DtmfTiming::fromName(const string& name){
+        if(name == "classic")   return TIMING_CLASSIC;
+        if(name == "fast")      return TIMING_FAST;
+        if(name == "itu")       return TIMING_ITU_Q24;
+
+        // Custom profile: tone:gap[:pause], in milliseconds.
+        DtmfTiming          custom  { 0, 0, 0 };
+        size_t              fields  { 0 };
+        std::istringstream  spec(name);
+        for(string tok; std::getline(spec, tok, ':'); ++fields){
+            if(tok.empty() || fields > 2 ||
+               tok.find_first_not_of("0123456789") != string::npos || tok.size() > 5)
+                throw string("DtmfTiming::fromName : invalid profile: ").append(name);
+            const size_t val { std::stoul(tok) };
+            switch(fields){
+                case 0:  custom.toneMs   =  val;  break;
+                case 1:  custom.gapMs    =  val;  break;
+                default: custom.pauseMs  =  val;
+            }
+        }
+
+        if(fields < 2 || custom.toneMs == 0)
+            throw string("DtmfTiming::fromName : invalid profile: ").append(name);
+        if(fields == 2)
+            custom.pauseMs  =  custom.gapMs;
+
+        return custom;
+    }
+
     Dtmf::Dtmf(size_t sSize, size_t whiteFract, bool whsound)
+     : Dtmf(std::make_shared<AlsaPlay>(sSize), sSize, whiteFract, whsound)
+    {}
+
+    Dtmf::Dtmf(std::shared_ptr<AudioSink> snk, size_t sSize, size_t whiteFract, bool whsound)
+     : Dtmf(snk,
+            DtmfTiming{ TIMING_CLASSIC.toneMs, 1000 / whiteFract, 1000 / whiteFract },
+            sSize, whsound)
+    {}
+
+    Dtmf::Dtmf(const DtmfTiming& tm, size_t sSize, bool whsound)
+     : Dtmf(std::make_shared<AlsaPlay>(sSize), tm, sSize, whsound)
+    {}
+
+    Dtmf::Dtmf(std::shared_ptr<AudioSink> snk, const DtmfTiming& tm, size_t sSize, bool whsound)
      : sampleSize{ sSize },
-       sampleNum{ static_cast<size_t>((0.25F/(1.0F/sampleSize))) },
-       dtmfMap { make_pair('1', make_tuple(1209, 697, vector<unsigned char>())),
-                 make_pair('2', make_tuple(1336, 697, vector<unsigned char>())),
-                 make_pair('3', make_tuple(1477, 697, vector<unsigned char>())),
-                 make_pair('4', make_tuple(1209, 770, vector<unsigned char>())),
-                 make_pair('5', make_tuple(1336, 770, vector<unsigned char>())),
-                 make_pair('6', make_tuple(1477, 770, vector<unsigned char>())),
-                 make_pair('7', make_tuple(1209, 852, vector<unsigned char>())),
-                 make_pair('8', make_tuple(1336, 852, vector<unsigned char>())),
-                 make_pair('9', make_tuple(1477, 852, vector<unsigned char>())),
-                 make_pair('0', make_tuple(1336, 941, vector<unsigned char>())),
-                 make_pair('*', make_tuple(1209, 941, vector<unsigned char>())),
-                 make_pair('#', make_tuple(1477, 941, vector<unsigned char>())),
-                 make_pair('A', make_tuple(1633, 697, vector<unsigned char>())),
-                 make_pair('B', make_tuple(1633, 770, vector<unsigned char>())),
-                 make_pair('C', make_tuple(1633, 852, vector<unsigned char>())),
-                 make_pair('D', make_tuple(1633, 941, vector<unsigned char>()))},
-       aplay(sSize),
-       white(sSize/whiteFract),
+       sampleNum{ (tm.toneMs * sSize) / 1000 },
+       sink{ snk },
+       timing(tm),
        whiteSound{whsound},
-       errMsg{"No error"}
-    {}
+       errMsg{"No error"},
+       symbolsPlayed{ 0 },
+       playNanos{ 0 },
+       symbolsSkipped{ 0 }
+    {
+        if(!sink)
+            throw string("Dtmf::Dtmf : invalid audio sink.");
+        if(sink->getChannels() != 1)
+            throw string("Dtmf::Dtmf : the sink must be mono, LaneTransmitter drives more channels.");
+    }
+
+    Dtmf::Dtmf(std::shared_ptr<AudioSink> snk, std::shared_ptr<const ToneBank> tones, bool whsound)
+     : sampleSize{ tones ? tones->getSampleSize() : 0 },
+       sampleNum{ tones ? tones->getToneLen() : 0 },
+       sink{ snk },
+       bank{ tones },
+       timing(tones ? tones->getTiming() : TIMING_CLASSIC),
+       whiteSound{whsound},
+       errMsg{"No error"},
+       symbolsPlayed{ 0 },
+       playNanos{ 0 },
+       symbolsSkipped{ 0 }
+    {
+        if(!sink || !bank)
+            throw string("Dtmf::Dtmf : invalid audio sink or tone bank.");
+        if(sink->getChannels() != 1)
+            throw string("Dtmf::Dtmf : the sink must be mono, LaneTransmitter drives more channels.");
+        if(sink->getFormat() != bank->getFormat())
+            throw string("Dtmf::Dtmf : the tone bank doesn't match the sample format of the sink.");
+    }
 
     float Dtmf::bgsine(short in) noexcept{
         static constexpr float coeff { 2 * M_PI * ( 1 / 65535.0F ) };
         return sinf( in * coeff );
     }
 
-    void Dtmf::init(size_t tlen) noexcept{
-       for(auto& el : dtmfMap){
-           unsigned int ad1 { static_cast<unsigned int>((get<TONE_1>(el.second) << 16) / sampleSize) },
-                        ad2 { static_cast<unsigned int>((get<TONE_2>(el.second) << 16) / sampleSize) };
-           size_t       l   { (tlen * sampleSize) / 1000 };
-           short        c1  { 0 },
-                        c2  { 0 };
-
-           for(size_t idx { 0 };  idx<l;  idx++, c1+= ad1, c2+= ad2 ) {
-                float   y   {  (Dtmf::bgsine(c1) + Dtmf::bgsine(c2)) * 0.5F };
-                (get<DATA>(el.second)).push_back(static_cast<unsigned char>((y + 1.0F) * 127.0F));
-           }
+    bool Dtmf::init(size_t tlen) noexcept{
+       if(tlen == 0)
+           tlen  =  timing.toneMs;
+
+       try{
+           bank       =  std::make_shared<const ToneBank>(sampleSize, timing, tlen, sink->getFormat());
+           sampleNum  =  (tlen * sampleSize) / 1000;
+       }catch(string& err){
+           errMsg  =  err;
+           return false;
+       }catch(...){
+           errMsg  =  "Dtmf::init : Unexpected Error.";
+           return false;
        }
+
+       return true;
     }
 
-    bool Dtmf::play(const string& str) const noexcept{
-       bool  ret{ true };
+    bool Dtmf::render(const char* const ch, size_t len, RawSoundArray& out) const noexcept{
+       bool  ret  { true };
+
+       out.clear();
+       if(!bank){
+           errMsg  =  "Dtmf::render : tones not initialized, call init().";
+           return false;
+       }
 
-       for(auto ch{str.begin()}; ch != str.end() ; ++ch){
-          ret = play(*ch);
-          if(!ret) break;
+       try{
+           const ToneSlot&       gap    { bank->gap() };
+           const unsigned char*  gapPcm { bank->data(gap) };
+           out.reserve(len * (bank->slot('0').length + gap.length));
+
+           for(size_t idx{0}; idx<len; ++idx){
+              const ToneSlot& sl { bank->slot(ch[idx]) };
+              if(sl.offset == ToneBank::NO_TONE){
+                  errMsg  =  string("Invalid symbol: ").append(1, ch[idx]);
+                  ret     =  false;
+                  break;
+              }
+
+              out.insert(out.end(), bank->data(sl), bank->data(sl) + sl.length);
+              if(whiteSound)
+                    out.insert(out.end(), gapPcm, gapPcm + gap.length);
+           }
+       }catch(...){
+           errMsg  =  "Dtmf::render : Unexpected Error.";
+           ret     =  false;
        }
 
        return ret;
     }
 
-    bool Dtmf::play(const char* const ch, size_t len) const noexcept{
-       bool  ret  { true };
+    void Dtmf::played(size_t count, std::chrono::steady_clock::time_point start) const noexcept{
+       symbolsPlayed  +=  count;
+       playNanos      +=  static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                    std::chrono::steady_clock::now() - start).count());
+    }
 
-       for(size_t idx{0}; idx<len; ++idx){
-          ret = play(*(ch+idx));
-          if(!ret) break;
-       }
+    bool Dtmf::playBatch(const char* const ch, size_t len) const noexcept{
+       const auto  start { std::chrono::steady_clock::now() };
+       bool        ret   { render(ch, len, renderBuff) };
+
+       if(!renderBuff.empty() && !sink->play(renderBuff, errMsg))
+           ret  =  false;
+       else if(!renderBuff.empty())                     // Rendering stops at an invalid symbol
+           played(static_cast<size_t>(std::find_if(ch, ch + len, [this](char sym){
+                                          return bank->slot(sym).offset == ToneBank::NO_TONE; }) - ch), start);
 
        return ret;
     }
 
-    bool Dtmf::play(const std::vector<char>& vec, size_t len)  const noexcept{
-       bool  ret  { true };
+    bool Dtmf::play(const string& str) const noexcept{
+       return playBatch(str.data(), str.size());
+    }
 
-       for(size_t idx{0}; idx<len; ++idx){
-          ret = play(vec.at(idx));
-          if(!ret) break;
-       }
+    bool Dtmf::play(const char* const ch, size_t len) const noexcept{
+       return playBatch(ch, len);
+    }
 
-       return ret;
+    bool Dtmf::play(const std::vector<char>& vec, size_t len)  const noexcept{
+       return playBatch(vec.data(), std::min(len, vec.size()));
     }
 
     bool Dtmf::play(const std::vector<char>& vec)  const noexcept{
-       bool  ret  { true };
+       return playBatch(vec.data(), vec.size());
+    }
 
-       for(auto el { vec.cbegin() }; el != vec.cend(); ++el){
-          ret = play(*el);
-          if(!ret) break;
+    PlayHandle Dtmf::submit(const string& str, PlayCallback cb) const{
+       RawSoundArray  pcm;
+
+       if(!render(str.data(), str.size(), pcm)){
+           auto job { std::make_shared<PlayJob>(RawSoundArray(), std::move(cb)) };
+           job->finish(PLAY_FAILED, errMsg);
+           return PlayHandle(job);
        }
 
-       return ret;
+       return sink->submit(std::move(pcm), std::move(cb));
+    }
+
+    const DtmfTiming& Dtmf::getTiming(void) const noexcept{
+          return timing;
+    }
+
+    PlayStats Dtmf::getStats(void) const noexcept{
+       PlayStats  stats { sink->getStats() };
+       stats.symbols  =  symbolsPlayed;
+       stats.seconds  =  static_cast<double>(playNanos) / 1.0E9;
+
+       return stats;
+    }
+
+    std::shared_ptr<const ToneBank> Dtmf::getBank(void) const noexcept{
+          return bank;
     }
 
     const string& Dtmf::getErrMsg(void) const noexcept{
           return errMsg;
     }
 
+    uint64_t Dtmf::getSkipped(void) const noexcept{
+          return symbolsSkipped;
+    }
+
     bool Dtmf::play(char ch) const noexcept{
-       bool  ret  { true };
-       switch(ch){
-              case '0':   case '1':   case '2':   case '3':
-              case '4':   case '5':   case '6':   case '7':
-              case '8':   case '9':   case '*':   case '#':
-              case 'A':   case 'B':   case 'C':   case 'D':
-                  aplay.play(get<DATA>(dtmfMap.at(ch)), errMsg);
-              break;
-              case 'a':   case 'b':   case 'c':   case 'd':
-                  aplay.play(get<DATA>(dtmfMap.at(toupper(ch))), errMsg);
-              break;
-              case ' ':
-                  aplay.play(white, errMsg);
-              break;
-          default:
-                  ret  =  false;
+       if(!bank){
+           errMsg  =  "Dtmf::play : tones not initialized, call init().";
+           return false;
        }
 
-       if(whiteSound)
-             aplay.play(white, errMsg);
+       const auto       start { std::chrono::steady_clock::now() };
+       const ToneSlot&  sl    { bank->slot(ch) };
+       bool             ret   { sl.offset != ToneBank::NO_TONE };
+
+       if(!ret)
+             errMsg  =  string("Invalid symbol: ").append(1, ch);
+       else if(!sink->play(bank->data(sl), sl.length, errMsg))
+             return false;
+
+       if(whiteSound && !sink->play(bank->data(bank->gap()), bank->gap().length, errMsg))
+             return false;
+
+       if(ret)
+             played(1, start);
 
        return ret;
     }
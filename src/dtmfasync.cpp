@@ -0,0 +1,302 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <poll.h>
+#include <fcntl.h>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+    using std::shared_ptr;
+
+    namespace {
+
+        constexpr int  ASYNC_POLL_MS { 20 };        // Longest wait while jobs are in flight
+
+    } // End Anonymous Namespace
+
+    // Playback thread of an AlsaPlay: it owns the pcm, in non blocking mode,
+    // from the first submit() to the destruction of the AlsaPlay.
+    class AlsaAsync{
+        public:
+            AlsaAsync(snd_pcm_t* pcm, size_t fBytes, PlayCounters& cnt);
+            ~AlsaAsync(void);
+
+            AlsaAsync(const AlsaAsync&)              = delete;
+            AlsaAsync& operator=(const AlsaAsync&)   = delete;
+
+            void push(const shared_ptr<PlayJob>& job);
+
+        private:
+            // A job completely written to the pcm, done when frame end is played.
+            struct Queued{
+                shared_ptr<PlayJob>  job;
+                uint64_t             end;
+            };
+
+            snd_pcm_t*                        handle;
+            size_t                            frameBytes;
+            PlayCounters&                     counters;
+            int                               wake[2];
+            std::mutex                        lock;
+            std::deque<shared_ptr<PlayJob>>   pending;
+            bool                              stopping;
+            std::thread                       worker;
+
+            void loop(void)                                                    noexcept;
+            void notify(void)                                                  noexcept;
+    };
+
+    AlsaAsync::AlsaAsync(snd_pcm_t* pcm, size_t fBytes, PlayCounters& cnt)
+       : handle{ pcm },
+         frameBytes{ fBytes },
+         counters( cnt ),
+         wake{ -1, -1 },
+         stopping{ false }
+    {
+        if(pipe2(wake, O_NONBLOCK | O_CLOEXEC) != 0)
+            throw string("AlsaAsync::AlsaAsync : can't create the wake up pipe.");
+
+        int err { snd_pcm_nonblock(handle, 1) };
+        if(err >= 0){
+            try{
+                worker  =  std::thread(&AlsaAsync::loop, this);
+            }catch(...){
+                snd_pcm_nonblock(handle, 0);
+                err  =  -EAGAIN;
+            }
+        }
+
+        if(err < 0){
+            close(wake[0]);
+            close(wake[1]);
+            throw string("AlsaAsync::AlsaAsync : can't start the playback thread: ").append(snd_strerror(err));
+        }
+    }
+
+    AlsaAsync::~AlsaAsync(void){
+        {
+            const std::lock_guard<std::mutex>  guard(lock);
+            stopping  =  true;
+        }
+        notify();
+        worker.join();
+
+        close(wake[0]);
+        close(wake[1]);
+    }
+
+    void AlsaAsync::push(const shared_ptr<PlayJob>& job){
+        {
+            const std::lock_guard<std::mutex>  guard(lock);
+            pending.push_back(job);
+        }
+        notify();
+    }
+
+    void AlsaAsync::notify(void) noexcept{
+        const char     byte { 0 };
+        const ssize_t  res  { write(wake[1], &byte, 1) };
+        static_cast<void>(res);                         // A full pipe already wakes the loop.
+    }
+
+    void AlsaAsync::loop(void) noexcept{
+        std::deque<Queued>   draining;
+        shared_ptr<PlayJob>  active;
+        size_t               offset  { 0 };             // Bytes of active already written
+        uint64_t             written { 0 };             // Frames written since the last prepare
+        vector<pollfd>       fds(1, pollfd{ wake[0], POLLIN, 0 });
+
+        try{
+            const int count { snd_pcm_poll_descriptors_count(handle) };
+            if(count > 0){
+                fds.resize(1 + count);
+                snd_pcm_poll_descriptors(handle, &fds[1], count);
+            }
+        }catch(...){}                                   // Timeout driven, then.
+
+        // Buffer drained: whatever was written has been played.
+        auto  played { [&](void){
+                           for(auto& queued : draining)
+                               queued.job->finish(PLAY_DONE, "");
+                           draining.clear();
+                           written  =  0;
+                       } };
+        auto  failed { [&](const string& err){
+                           if(active)
+                               active->finish(PLAY_FAILED, err);
+                           active.reset();
+                           for(auto& queued : draining)
+                               queued.job->finish(PLAY_FAILED, err);
+                           draining.clear();
+                           written  =  0;
+                           snd_pcm_drop(handle);
+                           snd_pcm_prepare(handle);
+                       } };
+
+        while(true){
+            shared_ptr<PlayJob>  next;
+            {
+                const std::lock_guard<std::mutex>  guard(lock);
+                if(stopping)
+                    break;
+                if(!active && !pending.empty()){
+                    next  =  pending.front();
+                    pending.pop_front();
+                }
+            }
+            if(next){
+                if(next->cancelled){
+                    next->finish(PLAY_CANCELLED, "");
+                    continue;
+                }
+                active  =  next;
+                offset  =  0;
+            }
+
+            // Completion: frames played are the written ones minus the pcm delay.
+            if(written > 0){
+                const snd_pcm_state_t  state { snd_pcm_state(handle) };
+                snd_pcm_sframes_t      delay { 0 };
+                if(state == SND_PCM_STATE_XRUN){
+                    played();
+                    snd_pcm_prepare(handle);
+                }else if(snd_pcm_delay(handle, &delay) == 0){
+                    const uint64_t  done { written - std::min<uint64_t>(std::max<snd_pcm_sframes_t>(delay, 0), written) };
+                    while(!draining.empty() && draining.front().end <= done){
+                        draining.front().job->finish(PLAY_DONE, "");
+                        draining.pop_front();
+                    }
+                }
+            }
+
+            // The job playing is cancelled: drop the pcm buffer and write again,
+            // from their start, the jobs queued behind it, which haven't started yet.
+            if(!draining.empty() && draining.front().job->cancelled){
+                snd_pcm_drop(handle);
+                snd_pcm_prepare(handle);
+                written  =  0;
+                draining.front().job->finish(PLAY_CANCELLED, "");
+                draining.pop_front();
+                {
+                    const std::lock_guard<std::mutex>  guard(lock);
+                    if(active)
+                        pending.push_front(active);
+                    for(auto queued { draining.rbegin() }; queued != draining.rend(); ++queued)
+                        pending.push_front(queued->job);
+                }
+                active.reset();
+                draining.clear();
+                continue;
+            }
+
+            // A cancelled job stops here; its queued frames are dropped unless
+            // they follow frames of other jobs still playing.
+            if(active && active->cancelled){
+                if(draining.empty() && written > 0){
+                    snd_pcm_drop(handle);
+                    snd_pcm_prepare(handle);
+                    written  =  0;
+                }
+                active->finish(PLAY_CANCELLED, "");
+                active.reset();
+                continue;
+            }
+
+            if(active){
+                const snd_pcm_sframes_t  avail { snd_pcm_avail(handle) };
+                const size_t             left  { (active->pcm.size() - offset) / frameBytes };
+                snd_pcm_sframes_t        res   { avail };
+
+                if(avail > 0 && left > 0){
+                    const size_t  chunk { std::min<size_t>(static_cast<size_t>(avail), left) };
+                    const auto    start { std::chrono::steady_clock::now() };
+                    res  =  snd_pcm_writei(handle, active->pcm.data() + offset, chunk);
+                    counters.write(chunk, res, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                   std::chrono::steady_clock::now() - start).count()));
+                }
+                if(res < 0 && res != -EAGAIN){
+                    played();
+                    const int  err { snd_pcm_recover(handle, static_cast<int>(res), 1) };
+                    if(err < 0){
+                        counters.failure();
+                        failed(string("snd_pcm_writei failed: ").append(snd_strerror(err)));
+                    }else{
+                        counters.xrun();
+                    }
+                    continue;
+                }
+                if(res > 0 && avail > 0 && left > 0){
+                    offset   +=  static_cast<size_t>(res) * frameBytes;
+                    written  +=  static_cast<uint64_t>(res);
+                }
+
+                if(active->pcm.size() - offset < frameBytes){
+                    draining.push_back(Queued{ active, written });
+                    active.reset();
+                    continue;
+                }
+            }else if(written > 0 && snd_pcm_state(handle) == SND_PCM_STATE_PREPARED){
+                // Nothing more to write: start even below the start threshold.
+                snd_pcm_start(handle);
+            }
+
+            poll(fds.data(), active ? fds.size() : 1, active || !draining.empty() ? ASYNC_POLL_MS : -1);
+            if(fds[0].revents & POLLIN){
+                char  buff[64];
+                while(read(wake[0], buff, sizeof(buff)) > 0){}
+            }
+        }
+
+        // Shutdown: queued audio is played out, jobs not completely written are cancelled.
+        snd_pcm_nonblock(handle, 0);
+        if(written > 0){
+            snd_pcm_drain(handle);
+            snd_pcm_prepare(handle);
+        }
+        played();
+        if(active)
+            active->finish(PLAY_CANCELLED, "");
+
+        std::deque<shared_ptr<PlayJob>>  left;
+        {
+            const std::lock_guard<std::mutex>  guard(lock);
+            left.swap(pending);
+        }
+        for(auto& job : left)
+            job->finish(PLAY_CANCELLED, "");
+    }
+
+    PlayHandle AlsaPlay::submit(RawSoundArray pcm, PlayCallback cb) const{
+        auto                               job { std::make_shared<PlayJob>(std::move(pcm), std::move(cb)) };
+        const std::lock_guard<std::mutex>  guard(asyncLock);
+
+        if(!async)
+            async  =  std::make_shared<AlsaAsync>(handle, frameBytes, counters);
+        async->push(job);
+
+        return PlayHandle(job);
+    }
+
+} // End Namespace
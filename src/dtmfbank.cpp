@@ -0,0 +1,164 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::shared_ptr;
+
+    namespace {
+
+        constexpr char      BANK_MAGIC[8]  { 'D', 'T', 'M', 'F', 'B', 'N', 'K', '1' };
+        constexpr uint32_t  BANK_ORDER     { 0x01020304 };     // Banks are saved in host byte order
+
+        // Followed by the arena at the next ALIGNMENT boundary.
+        struct BankFile{
+            char      magic[8];
+            uint32_t  order,
+                      format;
+            uint64_t  sampleSize,
+                      toneLen,
+                      toneMs,
+                      toneGap,
+                      tonePause,
+                      toneTime,
+                      arenaSize;
+            ToneSlot  gapSlot,
+                      index[256];
+        };
+
+        constexpr size_t  ARENA_OFFSET { (sizeof(BankFile) + ToneBank::ALIGNMENT - 1) & ~(ToneBank::ALIGNMENT - 1) };
+
+        bool validSlot(const ToneSlot& sl, uint64_t arena) noexcept{
+            return sl.offset == ToneBank::NO_TONE ||
+                   static_cast<uint64_t>(sl.offset) + sl.length <= arena;
+        }
+
+    } // End Anonymous Namespace
+
+    ToneBank::ToneBank(void) noexcept
+     : base{ nullptr },
+       sampleSize{ 0 },
+       toneLen{ 0 },
+       toneMs{ 0 },
+       arenaSize{ 0 },
+       format{ FORMAT_U8 },
+       timing(TIMING_CLASSIC)
+    {}
+
+    bool ToneBank::saveTo(const string& fileName) const noexcept{
+        try{
+            BankFile  head {};
+            memcpy(head.magic, BANK_MAGIC, sizeof(BANK_MAGIC));
+            head.order       =  BANK_ORDER;
+            head.format      =  static_cast<uint32_t>(format);
+            head.sampleSize  =  sampleSize;
+            head.toneLen     =  toneLen;
+            head.toneMs      =  toneMs;
+            head.toneGap     =  timing.gapMs;
+            head.tonePause   =  timing.pauseMs;
+            head.toneTime    =  timing.toneMs;
+            head.arenaSize   =  arenaSize;
+            head.gapSlot     =  gapSlot;
+            std::copy(index.begin(), index.end(), head.index);
+
+            const string   tmpName { fileName + ".tmp." + std::to_string(getpid()) };
+            std::ofstream  oFile(tmpName, std::ios::out | std::ios::binary | std::ios::trunc);
+            const char     pad[ALIGNMENT] {};
+            oFile.write(reinterpret_cast<const char*>(&head), sizeof(head));
+            oFile.write(pad, ARENA_OFFSET - sizeof(head));
+            oFile.write(reinterpret_cast<const char*>(base), arenaSize);
+            oFile.close();
+
+            if(!oFile || rename(tmpName.c_str(), fileName.c_str()) != 0){
+                unlink(tmpName.c_str());
+                return false;
+            }
+        }catch(...){
+            return false;
+        }
+
+        return true;
+    }
+
+    shared_ptr<const ToneBank> ToneBank::load(const string& fileName){
+        const int  fd { open(fileName.c_str(), O_RDONLY | O_CLOEXEC) };
+        if(fd < 0)
+            throw string("ToneBank::load : can't open file: ").append(fileName);
+
+        struct stat  info;
+        void*        mem   { MAP_FAILED };
+        const bool   sized { fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= ARENA_OFFSET };
+        if(sized)
+            mem  =  mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mem == MAP_FAILED)
+            throw string("ToneBank::load : can't map file: ").append(fileName);
+
+        const size_t                    len  { static_cast<size_t>(info.st_size) };
+        shared_ptr<unsigned char>       map(static_cast<unsigned char*>(mem),
+                                            [len](unsigned char* ptr){ munmap(ptr, len); });
+        const BankFile&                 head { *reinterpret_cast<const BankFile*>(mem) };
+
+        bool  valid { memcmp(head.magic, BANK_MAGIC, sizeof(BANK_MAGIC)) == 0 && head.order == BANK_ORDER &&
+                      head.format <= FORMAT_FLOAT && head.arenaSize <= len - ARENA_OFFSET &&
+                      head.sampleSize != 0 && validSlot(head.gapSlot, head.arenaSize) };
+        for(size_t idx{ 0 }; valid && idx < 256; ++idx)
+            valid  =  validSlot(head.index[idx], head.arenaSize);
+        if(!valid)
+            throw string("ToneBank::load : invalid tone bank: ").append(fileName);
+
+        shared_ptr<ToneBank>  bank(new ToneBank());
+        bank->storage     =  map;
+        bank->base        =  map.get() + ARENA_OFFSET;
+        bank->sampleSize  =  head.sampleSize;
+        bank->toneLen     =  head.toneLen;
+        bank->toneMs      =  head.toneMs;
+        bank->arenaSize   =  head.arenaSize;
+        bank->format      =  static_cast<SampleFormat>(head.format);
+        bank->timing      =  DtmfTiming{ head.toneTime, head.toneGap, head.tonePause };
+        bank->gapSlot     =  head.gapSlot;
+        std::copy(head.index, head.index + 256, bank->index.begin());
+
+        return bank;
+    }
+
+    shared_ptr<const ToneBank> ToneBank::cached(const string& fileName, size_t sSize, const DtmfTiming& tm,
+                                                size_t tlen, SampleFormat fmt){
+        try{
+            shared_ptr<const ToneBank>  bank { load(fileName) };
+            const DtmfTiming&           btm  { bank->getTiming() };
+            if(bank->getSampleSize() == sSize && bank->getToneMs() == tlen && bank->getFormat() == fmt &&
+               btm.toneMs == tm.toneMs && btm.gapMs == tm.gapMs && btm.pauseMs == tm.pauseMs)
+                return bank;
+        }catch(string&){}                               // Missing, stale or foreign: built again.
+
+        auto  bank { std::make_shared<const ToneBank>(sSize, tm, tlen, fmt) };
+        bank->saveTo(fileName);
+
+        return bank;
+    }
+
+} // End Namespace
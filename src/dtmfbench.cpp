@@ -0,0 +1,361 @@
+// -----------------------------------------------------------------
+// dtmfbench - benchmarks of dtmflib
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <parseCmdLine.hpp>
+#include <config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+using namespace dtmfutil;
+using namespace parcmdline;
+
+namespace {
+
+    using Clock  =  chrono::steady_clock;
+
+    // Discards the samples: the play path is measured without a sound card.
+    class NullSink : public AudioSink{
+        public:
+            explicit NullSink(SampleFormat fmt)                                    noexcept
+               : AudioSink(fmt),
+                 bytes{ 0 }
+            {}
+
+            using AudioSink::play;
+            bool play(const unsigned char* data,
+                      size_t               len,
+                      string&              errmsg)                      const   noexcept override{
+                static_cast<void>(data);
+                static_cast<void>(errmsg);
+                bytes  +=  len;
+                return true;
+            }
+
+        private:
+            mutable size_t   bytes;
+    };
+
+    struct BenchConfig{
+        size_t   runs,
+                 megs;
+        string   filter,
+                 tmpDir;
+    };
+
+    // One JSON object per line: rate is units per second over all the runs,
+    // latencies are per run, in microseconds.
+    void report(const string& name, const char* unit, double units, vector<double>& lat){
+        sort(lat.begin(), lat.end());
+
+        const double  total { accumulate(lat.begin(), lat.end(), 0.0) };
+        auto          pct   { [&lat](double frac){
+                                  return lat[static_cast<size_t>(frac * (lat.size() - 1) + 0.5)];
+                              } };
+
+        printf("{\"bench\":\"%s\",\"runs\":%zu,\"unit\":\"%s\",\"rate\":%.1f,"
+               "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+               name.c_str(), lat.size(), unit, total > 0.0 ? units * lat.size() * 1.0E6 / total : 0.0,
+               pct(0.5), pct(0.9), pct(0.99), lat.back());
+        fflush(stdout);
+    }
+
+    bool selected(const BenchConfig& cfg, const string& name) noexcept{
+        return cfg.filter.empty() || name.find(cfg.filter) != string::npos;
+    }
+
+    // units: work done by a single run of fn, in the unit reported.
+    template<typename F>
+    void measure(const BenchConfig& cfg, const string& name, const char* unit,
+                 double units, size_t runs, F&& fn){
+        if(!selected(cfg, name))
+            return;
+
+        fn();                                               // Warm up
+        vector<double>  lat;
+        lat.reserve(runs);
+        for(size_t run{ 0 }; run < runs; ++run){
+            const auto  start { Clock::now() };
+            fn();
+            lat.push_back(chrono::duration<double, micro>(Clock::now() - start).count());
+        }
+
+        report(name, unit, units, lat);
+    }
+
+    string tempFile(const BenchConfig& cfg, const char* tag){
+        string  name { cfg.tmpDir + "/dtmfbench-" + tag + "-XXXXXX" };
+        const int fd { mkstemp(&name[0]) };
+        if(fd < 0)
+            throw string("can't create a temporary file in: ").append(cfg.tmpDir);
+        close(fd);
+
+        return name;
+    }
+
+    const char* formatName(SampleFormat fmt) noexcept{
+        return fmt == FORMAT_U8 ? "u8" : (fmt == FORMAT_S16_LE ? "s16" : "float");
+    }
+
+    void benchSynthesis(const BenchConfig& cfg){
+        for(const size_t rate : { 8000, 48000 }){
+            for(const SampleFormat fmt : { FORMAT_U8, FORMAT_S16_LE, FORMAT_FLOAT }){
+                Dtmf          dtmf(make_shared<NullSink>(fmt), TIMING_CLASSIC, rate);
+                const double  samples { 16.0 * (TIMING_CLASSIC.toneMs * rate) / 1000 };
+                measure(cfg, string("init/") + to_string(rate) + "/" + formatName(fmt), "samples/s",
+                        samples, cfg.runs, [&dtmf](){ dtmf.init(); });
+            }
+        }
+    }
+
+    void benchPlay(const BenchConfig& cfg){
+        const string  symbols { "0123456789ABCD#*" };
+
+        for(const SampleFormat fmt : { FORMAT_U8, FORMAT_S16_LE, FORMAT_FLOAT }){
+            Dtmf    dtmf(make_shared<NullSink>(fmt), TIMING_CLASSIC, 8000);
+            size_t  next { 0 };
+            dtmf.init();
+
+            measure(cfg, string("play/symbol/") + formatName(fmt), "symbols/s", 1.0, cfg.runs * 100,
+                    [&](){ dtmf.play(symbols[next++ & 0x0F]); });
+
+            const string  batch { symbols + symbols + symbols + symbols };
+            measure(cfg, string("play/string/") + formatName(fmt), "symbols/s",
+                    static_cast<double>(batch.size()), cfg.runs,
+                    [&](){
+                        if(!dtmf.play(batch))
+                            throw string("play: ").append(dtmf.getErrMsg());
+                    });
+        }
+    }
+
+    // The generator pulled a small period at a time, as by a sound card callback.
+    void benchGenerator(const BenchConfig& cfg){
+        const string  symbols { "0123456789ABCD#*" };
+
+        for(const SampleFormat fmt : { FORMAT_U8, FORMAT_S16_LE, FORMAT_FLOAT }){
+            ToneGenerator          gen(8000, TIMING_CLASSIC, fmt);
+            vector<unsigned char>  period(256 * sampleBytes(fmt));
+            const double           samples { symbols.size() * ((TIMING_CLASSIC.toneMs + TIMING_CLASSIC.gapMs) * 8000.0) / 1000 };
+
+            measure(cfg, string("generate/") + formatName(fmt), "samples/s", samples, cfg.runs,
+                    [&](){
+                        if(!gen.push(symbols))
+                            throw string("generate: ").append(gen.getErrMsg());
+                        while(gen.fill(period.data(), 256) != 0) {}
+                    });
+        }
+    }
+
+    void benchDecoder(const BenchConfig& cfg){
+        Dtmf           dtmf(make_shared<NullSink>(FORMAT_FLOAT), TIMING_ITU_Q24, 8000);
+        RawSoundArray  pcm;
+        const string   symbols { "0123456789ABCD#*0123456789ABCD#*" };
+
+        dtmf.init();
+        if(!dtmf.render(symbols.data(), symbols.size(), pcm))
+            throw string("render: ").append(dtmf.getErrMsg());
+
+        vector<float>  wave(pcm.size() / sizeof(float));
+        memcpy(wave.data(), pcm.data(), wave.size() * sizeof(float));
+        DtmfDecoder    dec(8000);
+
+        measure(cfg, "decode/tones/8000", "samples/s", static_cast<double>(wave.size()), cfg.runs,
+                [&](){
+                    dec.reset();
+                    dec.feed(wave.data(), wave.size());
+                    if(dec.getSymbols() != symbols)
+                        throw string("decode/tones: wrong symbols: ").append(dec.getSymbols());
+                });
+    }
+
+    void benchConverters(const BenchConfig& cfg){
+        if(!selected(cfg, "encode/bin/j0") && !selected(cfg, "decode/bin/j0") &&
+           !selected(cfg, "encode/mt8870") && !selected(cfg, "decode/mt8870"))
+            return;
+
+        const string  data  { tempFile(cfg, "data")  },
+                      tones { tempFile(cfg, "tones") },
+                      mt    { tempFile(cfg, "mt")    },
+                      out   { tempFile(cfg, "out")   };
+        const double  megs  { static_cast<double>(cfg.megs) * (1U << 20) / 1.0E6 };
+
+        try{
+            {
+                mt19937                gen(1);
+                vector<unsigned char>  buff(1U << 20);
+                ofstream               oFile(data, ios::out | ios::binary | ios::trunc);
+                for(size_t meg{ 0 }; meg < cfg.megs; ++meg){
+                    for(auto& byte : buff)
+                        byte  =  static_cast<unsigned char>(gen());
+                    oFile.write(reinterpret_cast<const char*>(buff.data()), buff.size());
+                }
+                if(!oFile)
+                    throw string("can't write: ").append(data);
+            }
+
+            auto  check { [](bool ok, const string& what){
+                              if(!ok)
+                                  throw string(what).append(" failed.");
+                          } };
+
+            // Inputs of the decoders; rates are given in MB of decoded data.
+            check(BinFileToDtmf(data).saveTo(tones), "encode/bin");
+            check(BinFileToMT8870Dtmf(data).saveTo(mt), "encode/mt8870");
+
+            for(const size_t threads : { 1, 0 }){
+                const string  tag { threads == 1 ? "" : "/j0" };
+
+                measure(cfg, "encode/bin" + tag, "MB/s", megs, cfg.runs, [&](){
+                    check(BinFileToDtmf(data).saveTo(out, threads), "encode/bin");
+                });
+                measure(cfg, "decode/bin" + tag, "MB/s", megs, cfg.runs, [&](){
+                    check(DtmfToBinFile(tones).saveTo(out, threads), "decode/bin");
+                });
+            }
+
+            measure(cfg, "encode/mt8870", "MB/s", megs, cfg.runs, [&](){
+                check(BinFileToMT8870Dtmf(data).saveTo(out), "encode/mt8870");
+            });
+            measure(cfg, "decode/mt8870", "MB/s", megs, cfg.runs, [&](){
+                check(MT8870DtmfToBinFile(mt).saveTo(out), "decode/mt8870");
+            });
+        }catch(...){
+            for(const string* name : { &data, &tones, &mt, &out })
+                unlink(name->c_str());
+            throw;
+        }
+
+        for(const string* name : { &data, &tones, &mt, &out })
+            unlink(name->c_str());
+    }
+
+    // A recording of cfg.megs MB, ITU timing at 8 kHz, decoded as by dtmf -d.
+    void benchRecording(const BenchConfig& cfg){
+        if(!selected(cfg, "decode/wav") && !selected(cfg, "decode/wav/j0"))
+            return;
+
+        const string  wav   { tempFile(cfg, "wav") },
+                      out   { tempFile(cfg, "wavout") };
+        const double  megs  { static_cast<double>(cfg.megs) * (1U << 20) / 1.0E6 };
+
+        try{
+            {
+                auto          sink    { make_shared<WavFileSink>(wav, 8000) };
+                Dtmf          dtmf(sink, TIMING_ITU_Q24, 8000);
+                const size_t  symLen  { ((TIMING_ITU_Q24.toneMs + TIMING_ITU_Q24.gapMs) * 8000) / 1000 };
+                mt19937       gen(1);
+                string        symbols((cfg.megs << 20) / symLen, '0');
+                for(char& sym : symbols)
+                    sym  =  dtmfDigits[gen() & 0x0F];
+
+                dtmf.init();
+                if(!dtmf.play(symbols))
+                    throw string("decode/wav: ").append(dtmf.getErrMsg());
+                sink->close();
+            }
+
+            for(const size_t threads : { 1, 0 }){
+                const string  tag { threads == 1 ? "" : "/j0" };
+                measure(cfg, "decode/wav" + tag, "MB/s", megs, cfg.runs, [&](){
+                    DtmfDecoder  dec;
+                    if(!dec.saveTo(wav, out, DtmfDecoder::MIX_CHANNELS, threads))
+                        throw string("decode/wav: ").append(dec.getErrMsg());
+                });
+            }
+        }catch(...){
+            unlink(wav.c_str());
+            unlink(out.c_str());
+            throw;
+        }
+
+        unlink(wav.c_str());
+        unlink(out.c_str());
+    }
+
+    void paramError(const char* progname, const char* err) noexcept __attribute__ ((noreturn));
+
+    void paramError(const char* progname, const char* err) noexcept{
+        if(err != nullptr) cerr << err << "\n\n";
+
+        cerr << progname   << " - benchmarks of dtmflib.\n"
+             << "Syntax: \n"
+             << "       "  << progname << " [-r runs] [-s size] [-f filter] [-d dir] | [-h]\n\n"
+             << "       "  << "-r runs of every benchmark (default 20).                     \n"
+             << "       "  << "-s size in MB of the file used by the converters (default 4).\n"
+             << "       "  << "-f run only the benchmarks whose name contains this string.  \n"
+             << "       "  << "-d directory of the temporary files (default $TMPDIR or /tmp).\n"
+             << "       "  << "-h print this help message.                                  \n\n"
+             << "       "  << "Every result is printed on stdout as a JSON object per line. \n";
+
+        exit(1);
+    }
+
+    size_t numValue(const char* progname, const string& val, const char* err){
+        if(val.empty() || val.size() > 6 || val.find_first_not_of("0123456789") != string::npos ||
+           stoul(val) == 0)
+            paramError(progname, err);
+
+        return stoul(val);
+    }
+
+} // End Anonymous Namespace
+
+int main(int argc, char **argv) {
+    int          ret { 0 };
+    const char*  tmp { getenv("TMPDIR") };
+    BenchConfig  cfg { 20, 4, "", tmp != nullptr && *tmp != '\0' ? tmp : "/tmp" };
+
+    try{
+        if(argc != 1){
+            ParseCmdLine  pcl(argc, argv, "r:s:f:d:h");
+            if(pcl.getErrorState()){
+                const string  exitMsg { string("Invalid  parameter or value").append(pcl.getErrorMsg()) };
+                paramError(argv[0], exitMsg.c_str());
+            }
+            if(pcl.isSet('h'))  paramError(argv[0], "");
+            if(pcl.isSet('r'))  cfg.runs    =  numValue(argv[0], pcl.getValue('r'), "-r requires a number of runs.");
+            if(pcl.isSet('s'))  cfg.megs    =  numValue(argv[0], pcl.getValue('s'), "-s requires a size in MB.");
+            if(pcl.isSet('f'))  cfg.filter  =  pcl.getValue('f');
+            if(pcl.isSet('d'))  cfg.tmpDir  =  pcl.getValue('d');
+        }
+
+        benchSynthesis(cfg);
+        benchPlay(cfg);
+        benchGenerator(cfg);
+        benchDecoder(cfg);
+        benchConverters(cfg);
+        benchRecording(cfg);
+    }catch(string& err){
+        cerr << "Error: " << err << endl;
+        ret  =  1;
+    }catch(...){
+        cerr << "Unexpected Error.\n";
+        ret  =  1;
+    }
+
+    return ret;
+}
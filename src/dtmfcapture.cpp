@@ -0,0 +1,296 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cerrno>
+#include <cstring>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::ifstream;
+    using std::ios;
+
+    namespace {
+
+        constexpr unsigned int  CAPTURE_LATENCY_US { 40000 };   // Small periods: symbols arrive early
+
+        uint16_t readLe16(const char* buff) noexcept{
+            return static_cast<uint16_t>(static_cast<unsigned char>(buff[0]) |
+                                         static_cast<unsigned char>(buff[1]) << 8);
+        }
+
+        uint32_t readLe32(const char* buff) noexcept{
+            return static_cast<uint32_t>(readLe16(buff)) |
+                   static_cast<uint32_t>(readLe16(buff + 2)) << 16;
+        }
+
+    } // End Anonymous Namespace
+
+    AudioSource::AudioSource(size_t sSize, SampleFormat fmt, size_t chans) noexcept
+       : sampleSize{ sSize },
+         format{ fmt },
+         channels{ std::max<size_t>(chans, 1) }
+    {}
+
+    size_t AudioSource::getPeriod(void) const noexcept{
+        return std::max<size_t>(sampleSize / 100, 1);
+    }
+
+    size_t AudioSource::getSampleSize(void) const noexcept{
+        return sampleSize;
+    }
+
+    SampleFormat AudioSource::getFormat(void) const noexcept{
+        return format;
+    }
+
+    size_t AudioSource::getChannels(void) const noexcept{
+        return channels;
+    }
+
+    AlsaCapture::AlsaCapture(size_t sSize, string dev, SampleFormat fmt, size_t chans)
+     : AudioSource(sSize, fmt, chans),
+       handle{ nullptr },
+       device{ dev },
+       periodFrames{ AudioSource::getPeriod() },
+       overruns{ 0 }
+    {
+        int err{ 0 };
+        if((err = snd_pcm_open(&handle, device.c_str(), SND_PCM_STREAM_CAPTURE, 0)) < 0)
+            throw string("AlsaCapture::AlsaCapture : can't open pcm : ").append(snd_strerror(err));
+
+        const snd_pcm_format_t pcmFormat { format == FORMAT_U8     ? SND_PCM_FORMAT_U8     :
+                                           format == FORMAT_S16_LE ? SND_PCM_FORMAT_S16_LE :
+                                                                     SND_PCM_FORMAT_FLOAT_LE };
+        if((err = snd_pcm_set_params(handle,
+                            pcmFormat,
+                            SND_PCM_ACCESS_RW_INTERLEAVED,
+                            static_cast<unsigned int>(channels),
+                            sampleSize,
+                            1,
+                            CAPTURE_LATENCY_US)) < 0){
+            snd_pcm_close(handle);
+            throw string("AlsaCapture::AlsaCapture : can't set pcm : ").append(snd_strerror(err));
+        }
+
+        snd_pcm_uframes_t  bufferSize { 0 },
+                           periodSize { 0 };
+        if(snd_pcm_get_params(handle, &bufferSize, &periodSize) == 0 && periodSize > 0)
+            periodFrames  =  periodSize;
+    }
+
+    AlsaCapture::~AlsaCapture(void){
+        snd_pcm_drop(handle);
+        snd_pcm_close(handle);
+    }
+
+    bool AlsaCapture::read(unsigned char* data, size_t& frames, string& errmsg) const noexcept{
+        while(true){
+            const snd_pcm_sframes_t  got { snd_pcm_readi(handle, data, frames) };
+            if(got >= 0){
+                frames  =  static_cast<size_t>(got);
+                return true;
+            }
+            if(got == -EAGAIN){
+                snd_pcm_wait(handle, 100);
+                continue;
+            }
+
+            const int  err { snd_pcm_recover(handle, static_cast<int>(got), 1) };
+            if(err < 0){
+                errmsg  =  string("snd_pcm_readi failed: ").append(snd_strerror(err));
+                return false;
+            }
+            if(got == -EPIPE)
+                ++overruns;
+        }
+    }
+
+    size_t AlsaCapture::getPeriod(void) const noexcept{
+        return periodFrames;
+    }
+
+    uint64_t AlsaCapture::getOverruns(void) const noexcept{
+        return overruns;
+    }
+
+    WavFileSource::WavFileSource(const string& fileName)
+     : AudioSource(8000, FORMAT_U8, 1),
+       iFile(fileName, ios::in | ios::binary),
+       left{ 0 }
+    {
+        if(!iFile)
+            throw string("WavFileSource::WavFileSource : can't open file: ").append(fileName);
+
+        char      header[12];
+        if(!iFile.read(header, sizeof(header))          ||
+           memcmp(header, "RIFF", 4) != 0               ||
+           memcmp(header + 8, "WAVE", 4) != 0)
+            throw string("WavFileSource::WavFileSource : not a RIFF/WAVE file: ").append(fileName);
+
+        uint16_t  fmtTag   { 0 },
+                  chans    { 0 },
+                  bits     { 0 };
+        uint32_t  rate     { 0 };
+        bool      fmtFound { false };
+
+        while(true){
+            char chunk[8];
+            if(!iFile.read(chunk, sizeof(chunk)))
+                throw string("WavFileSource::WavFileSource : missing data chunk: ").append(fileName);
+
+            const uint32_t chunkLen { readLe32(chunk + 4) };
+            if(memcmp(chunk, "fmt ", 4) == 0){
+                char fmt[16];
+                if(chunkLen < sizeof(fmt) || !iFile.read(fmt, sizeof(fmt)))
+                    throw string("WavFileSource::WavFileSource : invalid fmt chunk: ").append(fileName);
+                fmtTag    =  readLe16(fmt);
+                chans     =  readLe16(fmt + 2);
+                rate      =  readLe32(fmt + 4);
+                bits      =  readLe16(fmt + 14);
+                fmtFound  =  true;
+                iFile.seekg(chunkLen - sizeof(fmt) + (chunkLen & 1), ios::cur);
+            }else if(memcmp(chunk, "data", 4) == 0){
+                left      =  chunkLen;
+                break;
+            }else{
+                iFile.seekg(chunkLen + (chunkLen & 1), ios::cur);
+            }
+        }
+
+        if(!fmtFound || chans == 0 || rate == 0                         ||
+           !((fmtTag == 1 && (bits == 8 || bits == 16)) || (fmtTag == 3 && bits == 32)))
+            throw string("WavFileSource::WavFileSource : unsupported format, U8, S16 or float required: ")
+                  .append(fileName);
+
+        sampleSize  =  rate;
+        channels    =  chans;
+        format      =  bits == 8 ? FORMAT_U8 : (bits == 16 ? FORMAT_S16_LE : FORMAT_FLOAT);
+    }
+
+    bool WavFileSource::read(unsigned char* data, size_t& frames, string& errmsg) const noexcept{
+        const size_t  frameLen { channels * sampleBytes(format) },
+                      want     { std::min(frames, left / frameLen) * frameLen };
+
+        // A truncated file ends at its last whole frame.
+        iFile.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(want));
+        const size_t  got      { static_cast<size_t>(iFile.gcount()) };
+        if(got < want && iFile.bad()){
+            errmsg  =  "WavFileSource::read : read error.";
+            return false;
+        }
+
+        frames  =  got / frameLen;
+        left    =  got < want ? 0 : left - got;
+        return true;
+    }
+
+    DtmfReceiver::DtmfReceiver(std::shared_ptr<AudioSource> src, size_t blockMs)
+     : source{ src },
+       decoder(src ? src->getSampleSize() : 8000, blockMs),
+       stopping{ false },
+       pending{ -1 },
+       symbols{ 0 },
+       bytes{ 0 },
+       errMsg{ "No error" }
+    {
+        if(!source)
+            throw string("DtmfReceiver::DtmfReceiver : invalid audio source.");
+    }
+
+    void DtmfReceiver::setCallback(SymbolCallback cb) noexcept{
+        callback  =  std::move(cb);
+    }
+
+    bool DtmfReceiver::run(std::ostream& out) noexcept{
+        try{
+            const size_t   period { source->getPeriod() };
+            RawSoundArray  buff(period * source->getChannels() * sampleBytes(source->getFormat()));
+            bool           wrote  { false };
+
+            decoder.reset();
+            decoder.setCallback([&](char sym, uint64_t sample){
+                ++symbols;
+                if(callback)
+                    callback(sym, sample);
+
+                const int  val { DtmfToBinFile::symbolValue(sym) };
+                if(pending < 0){
+                    pending  =  val;
+                }else{
+                    out.put(static_cast<char>((pending << 4) | val));
+                    pending  =  -1;
+                    wrote    =  true;
+                    ++bytes;
+                }
+            });
+
+            while(!stopping){
+                size_t  frames { period };
+                if(!source->read(buff.data(), frames, errMsg)){
+                    decoder.setCallback(nullptr);
+                    return false;
+                }
+                if(frames == 0)
+                    break;
+
+                decoder.feed(buff.data(), frames, source->getFormat(), source->getChannels());
+                if(wrote){
+                    out.flush();
+                    wrote  =  false;
+                }
+            }
+            decoder.flush();
+            decoder.setCallback(nullptr);
+            out.flush();
+
+            if(!out){
+                errMsg  =  "DtmfReceiver::run : write error.";
+                return false;
+            }
+        }catch(...){
+            decoder.setCallback(nullptr);
+            errMsg  =  "DtmfReceiver::run : Unexpected Error.";
+            return false;
+        }
+
+        return true;
+    }
+
+    void DtmfReceiver::stop(void) noexcept{
+        stopping  =  true;
+    }
+
+    uint64_t DtmfReceiver::getSymbols(void) const noexcept{
+        return symbols;
+    }
+
+    uint64_t DtmfReceiver::getBytes(void) const noexcept{
+        return bytes;
+    }
+
+    bool DtmfReceiver::hasPending(void) const noexcept{
+        return pending >= 0;
+    }
+
+    const string& DtmfReceiver::getErrMsg(void) const noexcept{
+        return errMsg;
+    }
+
+} // End Namespace
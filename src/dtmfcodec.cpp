@@ -0,0 +1,428 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DTMF_X86_DISPATCH
+#include <tmmintrin.h>
+#endif
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+
+    namespace {
+
+        constexpr size_t  PARALLEL_CHUNK { 1U << 20 };      // Input bytes per job, even
+
+        class FileDesc{
+            public:
+                explicit FileDesc(int desc) noexcept
+                    : fd{ desc }
+                {}
+
+                ~FileDesc(void){
+                    if(fd >= 0) close(fd);
+                }
+
+                FileDesc(const FileDesc&)              = delete;
+                FileDesc& operator=(const FileDesc&)   = delete;
+
+                int get(void)                                          const noexcept{
+                    return fd;
+                }
+
+            private:
+                int  fd;
+        };
+
+        bool readAt(int fd, char* buff, size_t len, off_t off) noexcept{
+            while(len > 0){
+                const ssize_t  res { pread(fd, buff, len, off) };
+                if(res < 0 && errno == EINTR) continue;
+                if(res <= 0)                  return false;
+                buff  +=  res;
+                len   -=  static_cast<size_t>(res);
+                off   +=  res;
+            }
+            return true;
+        }
+
+        bool writeAt(int fd, const char* buff, size_t len, off_t off) noexcept{
+            while(len > 0){
+                const ssize_t  res { pwrite(fd, buff, len, off) };
+                if(res < 0 && errno == EINTR) continue;
+                if(res <= 0)                  return false;
+                buff  +=  res;
+                len   -=  static_cast<size_t>(res);
+                off   +=  res;
+            }
+            return true;
+        }
+
+        // Size of a regular file, or false for pipes and devices, which can't be split.
+        bool regularSize(int fd, size_t& size) noexcept{
+            struct stat  st;
+            if(fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+                return false;
+            size  =  static_cast<size_t>(st.st_size);
+            return true;
+        }
+
+        // Hands the chunks out in order to a pool of threads, each one with its own
+        // buffers. Once a job fails no new chunk is taken, but the ones already
+        // taken, all lower than any chunk still to hand out, are completed.
+        template<typename Job>
+        bool runChunks(size_t chunks, size_t threads, Job job) noexcept{
+            std::atomic<size_t>  next   { 0 };
+            std::atomic<bool>    failed { false };
+            auto                 worker { [&](void){
+                                     try{
+                                         vector<char>  inBuff,
+                                                       outBuff;
+                                         while(!failed){
+                                             const size_t  idx { next++ };
+                                             if(idx >= chunks) break;
+                                             if(!job(idx, inBuff, outBuff)) failed = true;
+                                         }
+                                     }catch(...){
+                                         failed = true;
+                                     }
+                                 } };
+
+            if(threads == 0)
+                threads  =  std::max(std::thread::hardware_concurrency(), 1U);
+            threads  =  std::min(threads, chunks);
+
+            vector<std::thread>  pool;
+            try{
+                for(size_t idx{ 1 }; idx < threads; ++idx)
+                    pool.emplace_back(worker);
+            }catch(...){}                   // Fewer workers, still correct.
+
+            worker();
+            for(auto& th : pool)
+                th.join();
+
+            return !failed;
+        }
+
+        // Byte to symbol pair table: one lookup and one 2-byte store per input byte.
+        class PairTable{
+            public:
+                constexpr PairTable(void) noexcept
+                    : pairs{}
+                {
+                    for(size_t idx{ 0 }; idx < 0x100; ++idx){
+                        pairs[idx][0] = dtmfDigits[idx >> 4];
+                        pairs[idx][1] = dtmfDigits[idx & 0x0F];
+                    }
+                }
+
+                constexpr const char* operator[](size_t idx)           const noexcept{
+                    return pairs[idx];
+                }
+
+            private:
+                char  pairs[0x100][2];
+        };
+
+        // Symbol to nibble table, NO_NIBBLE outside the alphabet.
+        class NibbleTable{
+            public:
+                static constexpr unsigned char NO_NIBBLE { 0xFF };
+
+                constexpr NibbleTable(void) noexcept
+                    : nibbles{}
+                {
+                    for(size_t idx{ 0 }; idx < 0x100; ++idx)
+                        nibbles[idx] = NO_NIBBLE;
+                    for(size_t idx{ 0 }; idx < 0x10; ++idx)
+                        nibbles[static_cast<unsigned char>(dtmfDigits[idx])] = static_cast<unsigned char>(idx);
+                }
+
+                constexpr unsigned char operator[](char ch)            const noexcept{
+                    return nibbles[static_cast<unsigned char>(ch)];
+                }
+
+            private:
+                unsigned char  nibbles[0x100];
+        };
+
+        // Complete MT8870 frame of every byte value.
+        class FrameTable{
+            public:
+                constexpr FrameTable(void) noexcept
+                    : frames{}
+                {
+                    for(size_t idx{ 0 }; idx < 0x100; ++idx){
+                        const char     digits[3] { static_cast<char>('0' + idx / 100),
+                                                   static_cast<char>('0' + idx / 10 % 10),
+                                                   static_cast<char>('0' + idx % 10) };
+                        char*          frame     { frames[idx] };
+                        unsigned char  code      { 0 };
+
+                        for(size_t pos{ 0 }; pos < 3; ++pos){
+                            frame[pos * 2]      =  digits[pos];
+                            frame[pos * 2 + 1]  =  'D';
+                            if(BinFileToMT8870Dtmf::parity(digits[pos]))
+                                code += static_cast<unsigned char>(1U << pos);
+                        }
+                        frame[6]  =  static_cast<char>('0' + code);
+                        frame[7]  =  'D';
+                        frame[8]  =  'B';
+                        frame[9]  =  'D';
+                    }
+                }
+
+                constexpr const char* operator[](size_t idx)           const noexcept{
+                    return frames[idx];
+                }
+
+            private:
+                char  frames[0x100][BinFileToMT8870Dtmf::FRAME_LEN];
+        };
+
+        constexpr PairTable    pairTable;
+        constexpr FrameTable   frameTable;
+        constexpr NibbleTable  nibbleTable;
+
+#if defined(__SSE2__)
+        // Maps sixteen symbols to their nibbles; mask gets one bit per valid symbol.
+        inline __m128i nibbles(__m128i src, int& mask) noexcept{
+            auto range { [src](char lo, char hi){
+                             return _mm_and_si128(_mm_cmpgt_epi8(src, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                                                  _mm_cmplt_epi8(src, _mm_set1_epi8(static_cast<char>(hi + 1))));
+                         } };
+            const __m128i  digit  { range('0', '9') },
+                           letter { range('A', 'D') },
+                           hash   { _mm_cmpeq_epi8(src, _mm_set1_epi8('#')) },
+                           star   { _mm_cmpeq_epi8(src, _mm_set1_epi8('*')) };
+
+            mask  =  _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(digit, letter), _mm_or_si128(hash, star)));
+
+            return _mm_or_si128(_mm_or_si128(_mm_and_si128(digit,  _mm_sub_epi8(src, _mm_set1_epi8('0'))),
+                                             _mm_and_si128(letter, _mm_sub_epi8(src, _mm_set1_epi8('A' - 10)))),
+                                _mm_or_si128(_mm_and_si128(hash,   _mm_set1_epi8(0x0E)),
+                                             _mm_and_si128(star,   _mm_set1_epi8(0x0F))));
+        }
+
+        // Joins the nibble pairs of each 16 bit lane into one byte.
+        inline __m128i pack(__m128i nib) noexcept{
+            return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib, _mm_set1_epi16(0x00FF)), 4),
+                                _mm_srli_epi16(nib, 8));
+        }
+#endif
+
+        using EncodeKernel = void (*)(const unsigned char*, size_t, char*);
+
+        void encodeScalar(const unsigned char* in, size_t len, char* out) noexcept{
+            for(size_t idx{ 0 }; idx < len; ++idx)
+                memcpy(out + idx * 2, pairTable[in[idx]], 2);
+        }
+
+#if defined(DTMF_X86_DISPATCH)
+        // Sixteen bytes per step: split the nibbles, map both halves with
+        // a shuffle against the digit table, then interleave high/low.
+        __attribute__((target("ssse3")))
+        void encodeSsse3(const unsigned char* in, size_t len, char* out) noexcept{
+            const __m128i  digits { _mm_loadu_si128(reinterpret_cast<const __m128i*>(dtmfDigits)) },
+                           mask   { _mm_set1_epi8(0x0F) };
+            size_t         idx    { 0 };
+
+            for(; idx + 16 <= len; idx += 16){
+                const __m128i  src  { _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + idx)) },
+                               high { _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(src, 4), mask)) },
+                               low  { _mm_shuffle_epi8(digits, _mm_and_si128(src, mask)) };
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + idx * 2),      _mm_unpacklo_epi8(high, low));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + idx * 2 + 16), _mm_unpackhi_epi8(high, low));
+            }
+
+            encodeScalar(in + idx, len - idx, out + idx * 2);
+        }
+#endif
+
+        EncodeKernel selectEncoder(void) noexcept{
+#if defined(DTMF_X86_DISPATCH)
+            if(__builtin_cpu_supports("ssse3"))
+                return encodeSsse3;
+#endif
+            return encodeScalar;
+        }
+
+    } // End Anonymous Namespace
+
+    void BinFileToDtmf::encode(const unsigned char* in, size_t len, char* out) noexcept{
+        static const EncodeKernel  kernel { selectEncoder() };
+        kernel(in, len, out);
+    }
+
+    void BinFileToMT8870Dtmf::encode(const unsigned char* in, size_t len, char* out) noexcept{
+        for(size_t idx{ 0 }; idx < len; ++idx)
+            memcpy(out + idx * FRAME_LEN, frameTable[in[idx]], FRAME_LEN);
+    }
+
+    bool BinFileToDtmf::saveParallel(const string& outFile, size_t threads) const noexcept{
+        const FileDesc  in   { open(inName.c_str(), O_RDONLY) };
+        size_t          size { 0 };
+        if(!regularSize(in.get(), size))
+            return saveTo(outFile, 1);
+
+        const FileDesc  out  { open(outFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666) };
+        if(out.get() < 0 || ftruncate(out.get(), static_cast<off_t>(size * 2)) != 0)
+            return false;
+
+        return runChunks((size + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK, threads,
+                         [&](size_t idx, vector<char>& inBuff, vector<char>& outBuff){
+                             const size_t  off { idx * PARALLEL_CHUNK },
+                                           len { std::min(PARALLEL_CHUNK, size - off) };
+                             inBuff.resize(len);
+                             outBuff.resize(len * 2);
+                             if(!readAt(in.get(), inBuff.data(), len, static_cast<off_t>(off)))
+                                 return false;
+                             encode(reinterpret_cast<const unsigned char*>(inBuff.data()), len, outBuff.data());
+                             return writeAt(out.get(), outBuff.data(), len * 2, static_cast<off_t>(off * 2));
+                         });
+    }
+
+    bool DtmfToBinFile::saveParallel(const string& outFile, size_t threads) const noexcept{
+        const FileDesc  in   { open(inName.c_str(), O_RDONLY) };
+        size_t          size { 0 };
+        if(!regularSize(in.get(), size))
+            return saveTo(outFile, 1);
+
+        result  =  DecodeResult{ 0, 0, 0, DecodeResult::NO_OFFSET, "" };
+
+        const FileDesc  out  { open(outFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666) };
+        if(out.get() < 0 || ftruncate(out.get(), static_cast<off_t>(size / 2)) != 0){
+            result.errMsg  =  string("DtmfToBinFile::saveTo : can't open file: ").append(outFile);
+            return false;
+        }
+
+        // The lowest bad symbol found by any worker wins, as in a sequential pass.
+        std::mutex  lock;
+        size_t      bad      { DecodeResult::NO_OFFSET };
+        bool        trailing { false };
+        const bool  done     { runChunks((size + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK, threads,
+                               [&](size_t idx, vector<char>& inBuff, vector<char>& outBuff){
+                                   const size_t  off { idx * PARALLEL_CHUNK },
+                                                 len { std::min(PARALLEL_CHUNK, size - off) };
+                                   inBuff.resize(len);
+                                   outBuff.resize(len / 2);
+                                   if(!readAt(in.get(), inBuff.data(), len, static_cast<off_t>(off)))
+                                       return false;
+                                   const size_t  used { decode(inBuff.data(), len,
+                                                               reinterpret_cast<unsigned char*>(outBuff.data())) };
+                                   if(!writeAt(out.get(), outBuff.data(), used / 2, static_cast<off_t>(off / 2)))
+                                       return false;
+                                   if(used == len)
+                                       return true;
+
+                                   const bool  first { symbolValue(inBuff[used]) >= 0 },
+                                               last  { used + 1 == len };
+                                   const std::lock_guard<std::mutex>  guard(lock);
+                                   if(off + used + (first && !last ? 1 : 0) < bad){
+                                       bad       =  off + used + (first && !last ? 1 : 0);
+                                       trailing  =  first && last;
+                                   }
+                                   return false;
+                               }) };
+
+        if(bad != DecodeResult::NO_OFFSET){
+            result.errOffset  =  bad;
+            result.errMsg     =  string(trailing ? "Dtmf decoding: Invalid trailing character at offset: "
+                                                 : "Dtmf decoding: Invalid value at offset: ")
+                                 .append(std::to_string(bad));
+            result.bytes      =  bad / 2;
+            if(ftruncate(out.get(), static_cast<off_t>(result.bytes)) != 0)
+                result.errMsg.append(", output not truncated");
+        }else if(!done){
+            result.errMsg     =  "DtmfToBinFile::saveTo : read or write failed.";
+        }else{
+            result.bytes      =  size / 2;
+        }
+
+        return result.ok();
+    }
+
+    size_t MT8870DtmfToBinFile::decode(const char* in, size_t len, unsigned char* out) noexcept{
+        constexpr size_t  FRAME_LEN { BinFileToMT8870Dtmf::FRAME_LEN };
+        size_t            idx       { 0 };
+
+        // The digits give the value, then the whole frame must match its table entry.
+        for(; idx + FRAME_LEN <= len; idx += FRAME_LEN){
+            const unsigned  hund { static_cast<unsigned>(in[idx] - '0')     },
+                            tens { static_cast<unsigned>(in[idx + 2] - '0') },
+                            unit { static_cast<unsigned>(in[idx + 4] - '0') };
+            if(hund > 9 || tens > 9 || unit > 9)
+                break;
+            const unsigned  val  { hund * 100 + tens * 10 + unit };
+            if(val > 0xFF || memcmp(in + idx, frameTable[val], FRAME_LEN) != 0)
+                break;
+            out[idx / FRAME_LEN]  =  static_cast<unsigned char>(val);
+        }
+
+        return idx;
+    }
+
+    int DtmfToBinFile::symbolValue(char ch) noexcept{
+        const unsigned char  val { nibbleTable[ch] };
+        return val == NibbleTable::NO_NIBBLE ? -1 : val;
+    }
+
+    size_t DtmfToBinFile::decode(const char* in, size_t len, unsigned char* out) noexcept{
+        size_t  idx { 0 };
+
+#if defined(__SSE2__)
+        // Thirty-two symbols per step, validated and packed together.
+        for(; idx + 32 <= len; idx += 32){
+            int            maskLo { 0 },
+                           maskHi { 0 };
+            const __m128i  lo     { nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + idx)),      maskLo) },
+                           hi     { nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + idx + 16)), maskHi) };
+            if((maskLo & maskHi) != 0xFFFF)
+                break;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + idx / 2), _mm_packus_epi16(pack(lo), pack(hi)));
+        }
+#endif
+
+        for(; idx + 2 <= len; idx += 2){
+            const unsigned char  upper { nibbleTable[in[idx]] },
+                                 lower { nibbleTable[in[idx + 1]] };
+            if((upper | lower) > 0x0F)
+                break;
+            out[idx / 2]  =  static_cast<unsigned char>(upper << 4 | lower);
+        }
+
+        return idx;
+    }
+
+} // End Namespace
@@ -0,0 +1,540 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+    using std::ofstream;
+
+    namespace {
+
+        // Detection thresholds, relative to the energy of the block:
+        // the two strongest bins must hold most of the energy (purity),
+        // the block must not be silence, row/column twist is bounded
+        // and no other row or column may come close to the winners.
+        // 10 ms bins are about 100 Hz wide, wider than the 73 Hz between
+        // the lowest rows: a tone inside the 1.5% tolerance leaks up to
+        // 40% of its power in the next bin, so neighbours get a looser bound.
+        constexpr float  MIN_PURITY   { 0.5F    };
+        constexpr float  MIN_LEVEL    { 1.0E-4F };
+        constexpr float  MAX_TWIST    { 8.0F    };
+        constexpr float  MIN_PEAK     { 4.0F    };
+        constexpr float  MIN_ADJ_PEAK { 2.0F    };
+        constexpr size_t MIN_BLOCKS   { 2       };
+
+        // Clock recovery: tones seen before the estimates are trusted, weight
+        // of a new measure in the running averages, the range of lengths,
+        // relative to the estimate, taken as measures rather than glitches or
+        // pauses, the spread of tone lengths above which the clock is lost and
+        // the longest gap, in blocks, that can vanish between repeats.
+        constexpr size_t MIN_OBSERVED { 4       };
+        constexpr float  CLOCK_ALPHA  { 0.125F  };
+        constexpr float  MIN_RATIO    { 0.5F    };
+        constexpr float  MAX_RATIO    { 2.0F    };
+        constexpr float  MAX_SPREAD   { 0.25F   };
+        constexpr float  MAX_HIDDEN   { 2.0F    };
+
+        // Parallel decoding: segments of about this length, one per thread at a time.
+        constexpr size_t SEGMENT_SECONDS { 30   };
+        constexpr size_t READ_FRAMES     { 8192 };
+
+        uint16_t readLe16(const char* buff) noexcept{
+            return static_cast<uint16_t>(static_cast<unsigned char>(buff[0]) |
+                                         static_cast<unsigned char>(buff[1]) << 8);
+        }
+
+        // Interleaved frames to float samples, one channel or the mix of all.
+        void toMono(const unsigned char* pcm, size_t frames, SampleFormat fmt, size_t chans,
+                    size_t channel, float* out) noexcept{
+            const size_t  bytes    { sampleBytes(fmt) },
+                          frameLen { chans * bytes },
+                          first    { channel == DtmfDecoder::MIX_CHANNELS ? 0     : channel     },
+                          last     { channel == DtmfDecoder::MIX_CHANNELS ? chans : channel + 1 };
+
+            for(size_t frame{ 0 }; frame < frames; ++frame){
+                float sample { 0.0F };
+                for(size_t ch{ first }; ch < last; ++ch){
+                    const char* const  in { reinterpret_cast<const char*>(pcm + frame * frameLen + ch * bytes) };
+                    if(fmt == FORMAT_U8){
+                        sample += (static_cast<unsigned char>(*in) - 128.0F) * (1.0F / 128.0F);
+                    }else if(fmt == FORMAT_S16_LE){
+                        sample += static_cast<int16_t>(readLe16(in)) * (1.0F / 32768.0F);
+                    }else{
+                        float val { 0.0F };
+                        memcpy(&val, in, sizeof(val));
+                        sample += val;
+                    }
+                }
+                out[frame]  =  sample / (last - first);
+            }
+        }
+
+    } // End Anonymous Namespace
+
+    DtmfDecoder::DtmfDecoder(size_t sSize, size_t bMs)
+     : sampleSize{ 0 },
+       blockMs{ bMs },
+       blockLen{ 0 },
+       fill{ 0 },
+       run{ 0 },
+       toneBlocks{ 0 },
+       holes{ 0 },
+       idle{ 0 },
+       position{ 0 },
+       candidate{ 0 },
+       active{ 0 },
+       emitted{ false },
+       recovery{ false },
+       clock{ 0.0F, 0.0F, 0.0F, 0 },
+       coeff{},
+       errMsg{"No error"}
+    {
+        if(sSize == 0 || blockMs == 0)
+            throw string("DtmfDecoder::DtmfDecoder : invalid sample rate or block length.");
+
+        configure(sSize);
+    }
+
+    void DtmfDecoder::configure(size_t sSize) noexcept{
+        sampleSize  =  sSize;
+        blockLen    =  std::max<size_t>((sampleSize * blockMs) / 1000, 1);
+        block.assign(blockLen, 0.0F);
+
+        for(size_t idx{ 0 }; idx < DTMF_FREQS; ++idx){
+            coeff[idx]              = 2.0F * cosf(2.0F * static_cast<float>(M_PI) *
+                                                  dtmfRowFreq[idx] / sampleSize);
+            coeff[idx + DTMF_FREQS] = 2.0F * cosf(2.0F * static_cast<float>(M_PI) *
+                                                  dtmfColFreq[idx] / sampleSize);
+        }
+
+        reset();
+    }
+
+    void DtmfDecoder::reset(void) noexcept{
+        fill       =  0;
+        run        =  0;
+        position   =  0;
+        candidate  =  0;
+        emitted    =  false;
+        active     =  0;
+        toneBlocks =  0;
+        holes      =  0;
+        idle       =  SIZE_MAX / 2;     // What precedes the first tone isn't a gap
+        clock      =  Clock{ 0.0F, 0.0F, 0.0F, 0 };
+        symbols.clear();
+    }
+
+    char DtmfDecoder::detect(const float* data) const noexcept{
+        float  mean   { 0.0F },
+               energy { 0.0F };
+
+        for(size_t idx{ 0 }; idx < blockLen; ++idx)
+            mean += data[idx];
+        mean /= blockLen;
+
+        std::array<float, DTMF_FREQS * 2>  s1{},
+                                           s2{};
+        for(size_t idx{ 0 }; idx < blockLen; ++idx){
+            const float x { data[idx] - mean };
+            energy += x * x;
+            for(size_t fr{ 0 }; fr < DTMF_FREQS * 2; ++fr){
+                const float s { x + coeff[fr] * s1[fr] - s2[fr] };
+                s2[fr] = s1[fr];
+                s1[fr] = s;
+            }
+        }
+
+        if(energy < MIN_LEVEL * blockLen)
+            return 0;
+
+        std::array<float, DTMF_FREQS * 2>  power;
+        for(size_t fr{ 0 }; fr < DTMF_FREQS * 2; ++fr)
+            power[fr] = s1[fr] * s1[fr] + s2[fr] * s2[fr] - coeff[fr] * s1[fr] * s2[fr];
+
+        size_t row { 0 },
+               col { DTMF_FREQS };
+        for(size_t idx{ 1 }; idx < DTMF_FREQS; ++idx){
+            if(power[idx] > power[row])                           row = idx;
+            if(power[idx + DTMF_FREQS] > power[col])              col = idx + DTMF_FREQS;
+        }
+
+        const float rowPow { power[row] },
+                    colPow { power[col] };
+        if((rowPow + colPow) * 2.0F < MIN_PURITY * energy * blockLen)
+            return 0;
+        if(rowPow > colPow * MAX_TWIST || colPow > rowPow * MAX_TWIST)
+            return 0;
+
+        auto  peak { [](size_t idx, size_t win){ return idx + 1 == win || win + 1 == idx ? MIN_ADJ_PEAK : MIN_PEAK; } };
+        for(size_t idx{ 0 }; idx < DTMF_FREQS; ++idx){
+            if(idx != row && power[idx] * peak(idx, row) > rowPow)
+                return 0;
+            if(idx + DTMF_FREQS != col && power[idx + DTMF_FREQS] * peak(idx + DTMF_FREQS, col) > colPow)
+                return 0;
+        }
+
+        return dtmfKeypad[row][col - DTMF_FREQS];
+    }
+
+    void DtmfDecoder::push(float sample) noexcept{
+        ++position;
+        block[fill++] = sample;
+        if(fill < blockLen)
+            return;
+
+        fill = 0;
+        step(detect(block.data()));
+    }
+
+    void DtmfDecoder::step(char sym) noexcept{
+        if(sym != 0 && sym == candidate){
+            ++run;
+        }else{
+            candidate  =  sym;
+            run        =  1;
+            emitted    =  false;
+        }
+
+        if(active != 0){
+            if(sym == active && (holes == 0 || canBridge(holes))){
+                toneBlocks  +=  holes + 1;
+                holes        =  0;
+                emitted      =  true;
+                return;
+            }
+            // A break: the tone may come back, unless another one has taken over.
+            if(sym != active && !(sym != 0 && run >= MIN_BLOCKS) && canBridge(holes + 1)){
+                ++holes;
+                return;
+            }
+            endTone();
+        }
+
+        ++idle;
+        if(candidate != 0 && !emitted && run >= MIN_BLOCKS){
+            emit(candidate);
+            emitted     =  true;
+
+            const float  gap { static_cast<float>(idle - run) };
+            if(clock.observed > 0 && gap <= clock.tone * MAX_RATIO)     // Longer: a pause
+                clock.gap  =  clock.gap == 0.0F ? gap : clock.gap + CLOCK_ALPHA * (gap - clock.gap);
+
+            active      =  candidate;
+            toneBlocks  =  run;
+            holes       =  0;
+        }
+    }
+
+    void DtmfDecoder::emit(char sym) noexcept{
+        if(callback)
+            callback(sym, position);
+        else
+            symbols.push_back(sym);
+    }
+
+    bool DtmfDecoder::recovering(void) const noexcept{
+        return recovery && clock.observed >= MIN_OBSERVED && clock.spread <= clock.tone * MAX_SPREAD;
+    }
+
+    bool DtmfDecoder::canBridge(size_t len) const noexcept{
+        // A real gap is at least one block long, so keep that much margin.
+        return recovering() &&
+               toneBlocks + len + std::max(clock.gap, 1.0F) < clock.tone;
+    }
+
+    size_t DtmfDecoder::countRepeats(void) const noexcept{
+        // Only short gaps vanish, and only a length close to a whole number
+        // of tones is a run of them: anything else is one long tone.
+        if(!recovering() || clock.gap > MAX_HIDDEN)
+            return 0;
+        const float  tones { std::round(toneBlocks / clock.tone) };
+        if(tones < 2.0F || std::fabs(toneBlocks - tones * clock.tone) >
+                           tones * std::max(clock.spread, 1.0F) + (tones - 1.0F) * clock.gap)
+            return 0;
+        return static_cast<size_t>(tones) - 1;
+    }
+
+    void DtmfDecoder::endTone(void) noexcept{
+        const size_t  repeats { countRepeats() };
+        const float   tone    { static_cast<float>(toneBlocks) / (repeats + 1) };
+
+        for(size_t rep{ 0 }; rep < repeats; ++rep)
+            emit(active);
+
+        // Dropouts only shorten tones: the longest of the first ones is the safest
+        // start, trusted once the following ones, fragments included, agree with it.
+        if(clock.observed < MIN_OBSERVED){
+            clock.tone    =  std::max(clock.tone, tone);
+            clock.spread  =  clock.tone;
+            ++clock.observed;
+        }else{
+            clock.spread  +=  CLOCK_ALPHA * (std::min(std::fabs(tone - clock.tone), clock.tone) - clock.spread);
+            if(tone >= clock.tone * MIN_RATIO && tone <= clock.tone * MAX_RATIO){
+                clock.tone  +=  CLOCK_ALPHA * (tone - clock.tone);
+                ++clock.observed;
+            }
+        }
+
+        // The trailing break was the start of the gap.
+        idle        =  holes;
+        holes       =  0;
+        active      =  0;
+    }
+
+    void DtmfDecoder::feed(const unsigned char* pcm, size_t len) noexcept{
+        for(size_t idx{ 0 }; idx < len; ++idx)
+            push((static_cast<float>(pcm[idx]) - 128.0F) * (1.0F / 128.0F));
+    }
+
+    void DtmfDecoder::feed(const int16_t* pcm, size_t len) noexcept{
+        for(size_t idx{ 0 }; idx < len; ++idx)
+            push(static_cast<float>(pcm[idx]) * (1.0F / 32768.0F));
+    }
+
+    void DtmfDecoder::feed(const float* pcm, size_t len) noexcept{
+        for(size_t idx{ 0 }; idx < len; ++idx)
+            push(pcm[idx]);
+    }
+
+    void DtmfDecoder::flush(void) noexcept{
+        if(active != 0)
+            endTone();
+    }
+
+    string DtmfDecoder::decode(const RawSoundArray& pcm) noexcept{
+        reset();
+        feed(pcm.data(), pcm.size());
+        flush();
+        return symbols;
+    }
+
+    void DtmfDecoder::feed(const unsigned char* pcm, size_t frames, SampleFormat fmt, size_t chans,
+                           size_t channel) noexcept{
+        float  mono[256];
+
+        if(chans == 0 || (channel != MIX_CHANNELS && channel >= chans)){
+            errMsg  =  string("DtmfDecoder::feed : no channel ").append(std::to_string(channel))
+                       .append(" in frames of ").append(std::to_string(chans)).append(".");
+            return;
+        }
+
+        for(size_t done{ 0 }; done < frames; ){
+            const size_t  num { std::min(frames - done, sizeof(mono) / sizeof(float)) };
+            toMono(pcm + done * chans * sampleBytes(fmt), num, fmt, chans, channel, mono);
+            feed(mono, num);
+            done += num;
+        }
+    }
+
+    void DtmfDecoder::setCallback(SymbolCallback cb) noexcept{
+        callback  =  std::move(cb);
+    }
+
+    string DtmfDecoder::decodeWav(const string& fileName, size_t channel, size_t threads){
+        const WavFileSource  src(fileName);
+        const size_t         channels { src.getChannels() };
+
+        if(channel != MIX_CHANNELS && channel >= channels)
+            throw string("DtmfDecoder::decodeWav : no channel ").append(std::to_string(channel))
+                  .append(" in: ").append(fileName);
+
+        if(src.getSampleSize() != sampleSize)
+            configure(src.getSampleSize());
+        else
+            reset();
+
+        if(threads != 1){
+            decodeParallel(src, channel, threads);
+            return symbols;
+        }
+
+        // Stream the data chunk: constant memory whatever the recording length.
+        RawSoundArray  buff(channels * sampleBytes(src.getFormat()) * 8192);
+        string         err;
+        for(size_t frames{ 8192 }; ; frames = 8192){
+            if(!src.read(buff.data(), frames, err))
+                throw string("DtmfDecoder::decodeWav : ").append(err);
+            if(frames == 0)
+                break;
+            feed(buff.data(), frames, src.getFormat(), channels, channel);
+        }
+        flush();
+
+        return symbols;
+    }
+
+    size_t DtmfDecoder::findCut(const vector<float>& pcm, size_t from) const noexcept{
+        // Quarter block steps: a 25 ms gap holds two 10 ms blocks at some step.
+        const size_t  step { std::max<size_t>(blockLen / 4, 1) };
+
+        for(size_t pos{ from }; pos + blockLen * 2 <= pcm.size(); pos += step)
+            if(detect(&pcm[pos]) == 0 && detect(&pcm[pos + blockLen]) == 0)
+                return pos + blockLen;
+
+        return SIZE_MAX;
+    }
+
+    void DtmfDecoder::decodeParallel(const WavFileSource& src, size_t channel, size_t threads){
+        using Found  =  vector<std::pair<char, uint64_t>>;
+
+        if(threads == 0)
+            threads  =  std::max(std::thread::hardware_concurrency(), 1U);
+
+        const size_t   chans   { src.getChannels() },
+                       segLen  { std::max(sampleSize * SEGMENT_SECONDS, blockLen * 4) };
+        RawSoundArray  raw(chans * sampleBytes(src.getFormat()) * READ_FRAMES);
+        vector<float>  pcm;
+        uint64_t       base    { 0 };                   // Sample number of pcm[0]
+        size_t         want    { threads * segLen };
+        bool           eof     { false };
+        string         err;
+
+        while(!pcm.empty() || !eof){
+            while(!eof && pcm.size() < want){
+                size_t  frames { READ_FRAMES };
+                if(!src.read(raw.data(), frames, err))
+                    throw string("DtmfDecoder::decodeWav : ").append(err);
+                eof  =  frames == 0;
+                pcm.resize(pcm.size() + frames);
+                toMono(raw.data(), frames, src.getFormat(), chans, channel, pcm.data() + pcm.size() - frames);
+            }
+
+            // Segments end at cuts; the samples after the last one wait for the next batch.
+            vector<size_t>  cuts { 0 };
+            for(size_t pos{ segLen }; pos < pcm.size(); ){
+                const size_t  cut { findCut(pcm, pos) };
+                if(cut == SIZE_MAX)
+                    break;
+                cuts.push_back(cut);
+                pos  =  cut + segLen;
+            }
+            if(eof)
+                cuts.push_back(pcm.size());
+            if(cuts.size() < 2){                        // No tone free stretch yet: read more
+                want  +=  segLen;
+                continue;
+            }
+
+            vector<Found>        found(cuts.size() - 1);
+            vector<Clock>        clocks(found.size(), clock);
+            std::atomic<size_t>  next   { 0 };
+            std::atomic<bool>    failed { false };
+            auto                 worker { [&](void){
+                                     try{
+                                         DtmfDecoder  dec(sampleSize, blockMs);
+                                         dec.recovery  =  recovery;
+                                         for(size_t seg; !failed && (seg = next++) < found.size(); ){
+                                             Found&          out   { found[seg] };
+                                             const uint64_t  start { base + cuts[seg] };
+                                             dec.reset();
+                                             dec.clock  =  clock;         // Learnt up to the batch
+                                             dec.setCallback([&out, start](char sym, uint64_t sample){
+                                                 out.emplace_back(sym, start + sample);
+                                             });
+                                             dec.feed(pcm.data() + cuts[seg], cuts[seg + 1] - cuts[seg]);
+                                             dec.flush();                  // Segments are decoded apart
+                                             clocks[seg]  =  dec.clock;
+                                         }
+                                     }catch(...){
+                                         failed  =  true;
+                                     }
+                                 } };
+
+            vector<std::thread>  pool;
+            try{
+                for(size_t idx{ 1 }; idx < std::min(threads, found.size()); ++idx)
+                    pool.emplace_back(worker);
+            }catch(...){}                               // Fewer workers, still correct.
+            worker();
+            for(auto& th : pool)
+                th.join();
+            if(failed)
+                throw string("DtmfDecoder::decodeWav : segment decoding failed.");
+
+            for(const Found& seg : found){
+                for(const auto& sym : seg){
+                    if(callback)
+                        callback(sym.first, sym.second);
+                    else
+                        symbols.push_back(sym.first);
+                }
+            }
+
+            // The next batch goes on from the last segment that learnt a clock.
+            for(auto it{ clocks.rbegin() }; it != clocks.rend(); ++it){
+                if(it->observed >= MIN_OBSERVED){
+                    clock  =  *it;
+                    break;
+                }
+            }
+
+            base  +=  cuts.back();
+            pcm.erase(pcm.begin(), pcm.begin() + cuts.back());
+            want   =  threads * segLen;
+        }
+    }
+
+    bool DtmfDecoder::saveTo(const string& wavFile, const string& outFile, size_t channel, size_t threads) noexcept{
+        bool ret{ true };
+        try{
+            const string  decoded { decodeWav(wavFile, channel, threads) };
+            ofstream      oFile(outFile, ofstream::out);
+            if(!oFile)
+                throw string("DtmfDecoder::saveTo : can't open file: ").append(outFile);
+            oFile << decoded;
+            oFile.close();
+            if(!oFile)
+                throw string("DtmfDecoder::saveTo : can't write file: ").append(outFile);
+        }catch(string& err){
+            errMsg  =  err;
+            ret     =  false;
+        }catch(...){
+            errMsg  =  "DtmfDecoder::saveTo : Unexpected Error.";
+            ret     =  false;
+        }
+
+        return ret;
+    }
+
+    void DtmfDecoder::setClockRecovery(bool on) noexcept{
+        recovery  =  on;
+    }
+
+    float DtmfDecoder::getToneMs(void) const noexcept{
+        return clock.observed < MIN_OBSERVED ? 0.0F : clock.tone * blockLen * 1000.0F / sampleSize;
+    }
+
+    float DtmfDecoder::getGapMs(void) const noexcept{
+        return clock.observed < MIN_OBSERVED ? 0.0F : clock.gap * blockLen * 1000.0F / sampleSize;
+    }
+
+    const string& DtmfDecoder::getSymbols(void) const noexcept{
+          return symbols;
+    }
+
+    const string& DtmfDecoder::getErrMsg(void) const noexcept{
+          return errMsg;
+    }
+
+} // End Namespace
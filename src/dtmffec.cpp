@@ -0,0 +1,394 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cstring>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+
+    namespace {
+
+        constexpr size_t  MSG_BYTES { FecFrame::BYTES - FecFrame::PARITY };   // Header, data and CRC
+        constexpr size_t  PARITY    { FecFrame::PARITY };
+        constexpr size_t  REPAIR    { 8 };      // Symbols between the realignments tried in a frame
+
+        // GF(256) over x^8 + x^4 + x^3 + x^2 + 1 and the generator polynomial
+        // of the code, with roots alpha^0 .. alpha^(PARITY - 1), highest degree first.
+        class Galois{
+            public:
+                Galois(void) noexcept{
+                    unsigned  val { 1 };
+                    for(size_t idx{ 0 }; idx < 255; ++idx){
+                        expTable[idx]  =  static_cast<unsigned char>(val);
+                        logTable[val]  =  static_cast<unsigned char>(idx);
+                        val          <<=  1;
+                        if(val & 0x100)
+                            val  ^=  0x11D;
+                    }
+                    for(size_t idx{ 255 }; idx < sizeof(expTable); ++idx)
+                        expTable[idx]  =  expTable[idx - 255];
+                    logTable[0]  =  0;
+
+                    memset(gen, 0, sizeof(gen));
+                    gen[0]  =  1;
+                    for(size_t root{ 0 }; root < PARITY; ++root)
+                        for(size_t idx{ root + 1 }; idx > 0; --idx)
+                            gen[idx]  ^=  mul(gen[idx - 1], expTable[root]);
+                }
+
+                unsigned char mul(unsigned char lhs, unsigned char rhs)   const noexcept{
+                    return lhs == 0 || rhs == 0 ? 0 : expTable[logTable[lhs] + logTable[rhs]];
+                }
+
+                unsigned char div(unsigned char lhs, unsigned char rhs)   const noexcept{
+                    return lhs == 0 ? 0 : expTable[logTable[lhs] + 255 - logTable[rhs]];
+                }
+
+                unsigned char power(size_t exp)                          const noexcept{
+                    return expTable[exp % 255];
+                }
+
+                unsigned char generator(size_t idx)                      const noexcept{
+                    return gen[idx];
+                }
+
+            private:
+                unsigned char  expTable[512],
+                               logTable[256],
+                               gen[PARITY + 1];
+        };
+
+        const Galois& galois(void) noexcept{
+            static const Galois  tables;
+            return tables;
+        }
+
+        // CRC-16/CCITT-FALSE.
+        uint16_t crc16(const unsigned char* data, size_t len) noexcept{
+            uint16_t  crc { 0xFFFF };
+
+            for(size_t idx{ 0 }; idx < len; ++idx){
+                crc  ^=  static_cast<uint16_t>(data[idx] << 8);
+                for(int bit{ 0 }; bit < 8; ++bit)
+                    crc  =  static_cast<uint16_t>(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+            }
+
+            return crc;
+        }
+
+        // Fills the last PARITY bytes of the code word from the first MSG_BYTES.
+        void rsEncode(unsigned char* word) noexcept{
+            const Galois&  gf { galois() };
+            unsigned char  rem[PARITY] {};
+
+            for(size_t idx{ 0 }; idx < MSG_BYTES; ++idx){
+                const unsigned char  coef { static_cast<unsigned char>(word[idx] ^ rem[0]) };
+                memmove(rem, rem + 1, PARITY - 1);
+                rem[PARITY - 1]  =  0;
+                if(coef != 0)
+                    for(size_t pos{ 0 }; pos < PARITY; ++pos)
+                        rem[pos]  ^=  gf.mul(gf.generator(pos + 1), coef);
+            }
+
+            memcpy(word + MSG_BYTES, rem, PARITY);
+        }
+
+        bool syndromes(const unsigned char* word, unsigned char* synd) noexcept{
+            const Galois&  gf    { galois() };
+            bool           clean { true };
+
+            for(size_t root{ 0 }; root < PARITY; ++root){
+                unsigned char  val { 0 };
+                const unsigned char  alpha { gf.power(root) };
+                for(size_t idx{ 0 }; idx < FecFrame::BYTES; ++idx)
+                    val  =  static_cast<unsigned char>(gf.mul(val, alpha) ^ word[idx]);
+                synd[root]  =  val;
+                clean      &=  val == 0;
+            }
+
+            return clean;
+        }
+
+        // Berlekamp-Massey, Chien search and Forney: corrects up to PARITY / 2
+        // wrong bytes in place, returning their number or -1.
+        int rsDecode(unsigned char* word) noexcept{
+            const Galois&  gf { galois() };
+            unsigned char  synd[PARITY];
+            if(syndromes(word, synd))
+                return 0;
+
+            // Error locator, lowest degree first.
+            unsigned char  loc[PARITY + 1]  { 1 },
+                           prev[PARITY + 1] { 1 },
+                           last             { 1 };
+            size_t         errs             { 0 },
+                           shift            { 1 };
+            for(size_t step{ 0 }; step < PARITY; ++step){
+                unsigned char  delta { synd[step] };
+                for(size_t idx{ 1 }; idx <= errs; ++idx)
+                    delta  ^=  gf.mul(loc[idx], synd[step - idx]);
+                if(delta == 0){
+                    ++shift;
+                    continue;
+                }
+
+                unsigned char        saved[PARITY + 1];
+                const unsigned char  coef { gf.div(delta, last) };
+                memcpy(saved, loc, sizeof(saved));
+                for(size_t idx{ 0 }; idx + shift <= PARITY; ++idx)
+                    loc[idx + shift]  ^=  gf.mul(coef, prev[idx]);
+                if(2 * errs <= step){
+                    errs   =  step + 1 - errs;
+                    memcpy(prev, saved, sizeof(prev));
+                    last   =  delta;
+                    shift  =  1;
+                }else{
+                    ++shift;
+                }
+            }
+            if(errs > PARITY / 2)
+                return -1;
+
+            // Error evaluator: syndromes times locator, modulo x^PARITY.
+            unsigned char  eval[PARITY] {};
+            for(size_t deg{ 0 }; deg < PARITY; ++deg)
+                for(size_t idx{ 0 }; idx <= std::min(deg, errs); ++idx)
+                    eval[deg]  ^=  gf.mul(loc[idx], synd[deg - idx]);
+
+            size_t  found { 0 };
+            for(size_t pos{ 0 }; pos < FecFrame::BYTES; ++pos){
+                const size_t         deg  { FecFrame::BYTES - 1 - pos };
+                const unsigned char  inv  { gf.power(255 - deg % 255) };
+                unsigned char        val  { 0 },
+                                     num  { 0 },
+                                     den  { 0 },
+                                     xpow { 1 };
+                for(size_t idx{ 0 }; idx <= errs; ++idx, xpow = gf.mul(xpow, inv)){
+                    val  ^=  gf.mul(loc[idx], xpow);
+                    if(idx & 1)                              // Formal derivative, odd terms
+                        den  ^=  gf.mul(loc[idx], gf.div(xpow, inv));
+                }
+                if(val != 0)
+                    continue;
+
+                xpow  =  1;
+                for(size_t idx{ 0 }; idx < PARITY; ++idx, xpow = gf.mul(xpow, inv))
+                    num  ^=  gf.mul(eval[idx], xpow);
+                if(den == 0)
+                    return -1;
+                word[pos]  ^=  gf.mul(gf.power(deg), gf.div(num, den));
+                ++found;
+            }
+
+            if(found != errs || !syndromes(word, synd))
+                return -1;
+
+            return static_cast<int>(found);
+        }
+
+    } // End Anonymous Namespace
+
+    void FecFrame::encode(char* out) const noexcept{
+        unsigned char  word[BYTES];
+
+        word[0]  =  static_cast<unsigned char>(seq & 0xFF);
+        word[1]  =  static_cast<unsigned char>((seq >> 8) & 0xFF);
+        word[2]  =  static_cast<unsigned char>((seq >> 16) & 0xFF);
+        word[3]  =  static_cast<unsigned char>((seq >> 24) & 0xFF);
+        word[4]  =  static_cast<unsigned char>(length);
+        word[5]  =  last ? 0x01 : 0x00;
+        memcpy(word + HEADER, data, length);
+        memset(word + HEADER + length, 0, DATA - length);
+
+        const uint16_t  crc { crc16(word, HEADER + DATA) };
+        word[HEADER + DATA]      =  static_cast<unsigned char>(crc >> 8);
+        word[HEADER + DATA + 1]  =  static_cast<unsigned char>(crc & 0xFF);
+        rsEncode(word);
+
+        BinFileToDtmf::encode(word, BYTES, out);
+    }
+
+    bool FecFrame::decode(const char* in, FecFrame& frame, size_t& corrected) noexcept{
+        unsigned char  word[BYTES];
+
+        for(size_t idx{ 0 }; idx < BYTES; ++idx){
+            const int  upper { DtmfToBinFile::symbolValue(in[idx * 2]) },
+                       lower { DtmfToBinFile::symbolValue(in[idx * 2 + 1]) };
+            word[idx]  =  static_cast<unsigned char>((upper < 0 ? 0 : upper) << 4 | (lower < 0 ? 0 : lower));
+        }
+
+        const int  fixed { rsDecode(word) };
+        if(fixed < 0)
+            return false;
+
+        // The CRC catches the words corrected to the wrong code word.
+        const uint16_t  crc { crc16(word, HEADER + DATA) };
+        if(word[HEADER + DATA] != (crc >> 8) || word[HEADER + DATA + 1] != (crc & 0xFF) ||
+           word[4] > DATA || (word[5] & ~0x01) != 0 || (word[5] == 0 && word[4] != DATA))
+            return false;
+
+        frame.seq     =  static_cast<uint32_t>(word[0])       | static_cast<uint32_t>(word[1]) << 8 |
+                         static_cast<uint32_t>(word[2]) << 16 | static_cast<uint32_t>(word[3]) << 24;
+        frame.length  =  word[4];
+        frame.last    =  word[5] != 0;
+        memcpy(frame.data, word + HEADER, DATA);
+        corrected     =  static_cast<size_t>(fixed);
+
+        return true;
+    }
+
+    void BinFileToDtmf::writeFec(std::ostream& out) const{
+        vector<char>  inBuff(ENCODE_BLOCK),
+                      outBuff((ENCODE_BLOCK / FecFrame::DATA + 1) * FecFrame::SYMBOLS);
+        FecFrame      frame  { 0, 0, false, {} };
+        size_t        filled { 0 };
+
+        // A full frame is sent only when more data follows: the last one,
+        // possibly empty, carries the flag.
+        for(std::streamsize len { read(inBuff.data(), inBuff.size()) };
+            len > 0;
+            len = read(inBuff.data(), inBuff.size())){
+                 char*  dest { outBuff.data() };
+                 for(size_t pos{ 0 }; pos < static_cast<size_t>(len); ){
+                     if(filled == FecFrame::DATA){
+                         frame.length  =  filled;
+                         frame.encode(dest);
+                         dest         +=  FecFrame::SYMBOLS;
+                         ++frame.seq;
+                         filled        =  0;
+                     }
+                     const size_t  count { std::min(FecFrame::DATA - filled, static_cast<size_t>(len) - pos) };
+                     memcpy(frame.data + filled, inBuff.data() + pos, count);
+                     filled  +=  count;
+                     pos     +=  count;
+                 }
+                 out.write(outBuff.data(), dest - outBuff.data());
+        }
+
+        frame.length  =  filled;
+        frame.last    =  true;
+        frame.encode(outBuff.data());
+        out.write(outBuff.data(), FecFrame::SYMBOLS);
+    }
+
+    void DtmfToBinFile::readFec(std::ostream& out) const noexcept{
+        DecodeResult&   res      { result };
+        vector<char>    inBuff(DECODE_BLOCK);
+        string          window;                 // Symbols not decoded yet, SLIP of history
+        vector<size_t>  offsets;                // Input offset of every symbol in window
+        size_t          pos      { 0 },
+                        offset   { 0 };
+        uint32_t        expected { 0 };
+        bool            done     { false };
+        FecFrame        frame;
+
+        res  =  DecodeResult{ 0, 0, 0, DecodeResult::NO_OFFSET, "" };
+
+        // Decodes the frames in window; at the end of the input the last one
+        // may be short of the symbols dropped by the link.
+        auto  frames { [&](bool eof){
+            while(!done && res.ok() && (eof ? pos < window.size() : window.size() - pos >= FecFrame::SYMBOLS + FecFrame::SLIP)){
+                size_t  fixed { 0 },
+                        next  { 0 };
+                bool    found { false };
+                auto    tryAt { [&](const char* in, size_t end){
+                                    found  =  FecFrame::decode(in, frame, fixed) && frame.seq == expected;
+                                    next   =  end;
+                                } };
+
+                for(size_t slip{ 0 }; slip <= FecFrame::SLIP * 2 && !found; ++slip){
+                    // pos, pos + 1, pos - 1, pos + 2 ...: symbols inserted or lost before the frame.
+                    const size_t  dist  { (slip + 1) / 2 },
+                                  start { slip & 1 ? pos + dist : pos - std::min(dist, pos) };
+                    if((slip & 1 || dist <= pos) && start + FecFrame::SYMBOLS <= window.size())
+                        tryAt(window.data() + start, start + FecFrame::SYMBOLS);
+                }
+
+                // A symbol lost or duplicated inside the frame: it's realigned every REPAIR
+                // symbols, the bytes between the cut and the real position are corrected.
+                char  fixBuff[FecFrame::SYMBOLS];
+                for(size_t cut{ 0 }; cut < FecFrame::SYMBOLS && !found; cut += REPAIR){
+                    if(pos + FecFrame::SYMBOLS - 1 <= window.size()){
+                        memcpy(fixBuff, window.data() + pos, cut);
+                        fixBuff[cut]  =  dtmfDigits[0];
+                        memcpy(fixBuff + cut + 1, window.data() + pos + cut, FecFrame::SYMBOLS - 1 - cut);
+                        tryAt(fixBuff, pos + FecFrame::SYMBOLS - 1);
+                    }
+                    if(!found && pos + FecFrame::SYMBOLS + 1 <= window.size()){
+                        memcpy(fixBuff, window.data() + pos, cut);
+                        memcpy(fixBuff + cut, window.data() + pos + cut + 1, FecFrame::SYMBOLS - cut);
+                        tryAt(fixBuff, pos + FecFrame::SYMBOLS + 1);
+                    }
+                }
+
+                if(!found){
+                    res.errOffset  =  offsets[pos];
+                    res.errMsg     =  string("Dtmf decoding: Uncorrectable frame at offset: ")
+                                      .append(std::to_string(res.errOffset));
+                    break;
+                }
+
+                out.write(reinterpret_cast<const char*>(frame.data), frame.length);
+                res.bytes      +=  frame.length;
+                res.corrected  +=  fixed;
+                pos             =  next;
+                done            =  frame.last;
+                ++expected;
+            }
+
+            if(pos > FecFrame::SLIP){
+                window.erase(0, pos - FecFrame::SLIP);
+                offsets.erase(offsets.begin(), offsets.begin() + (pos - FecFrame::SLIP));
+                pos  =  FecFrame::SLIP;
+            }
+        } };
+
+        try{
+            for(std::streamsize len { iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size()) };
+                len > 0 && res.ok() && !done;
+                offset += static_cast<size_t>(len),
+                len = iFile.rdbuf()->sgetn(inBuff.data(), inBuff.size())){
+                     for(size_t idx{ 0 }; idx < static_cast<size_t>(len); ++idx){
+                         if(mode != DECODE_STRICT && std::isspace(static_cast<unsigned char>(inBuff[idx]))){
+                             ++res.skipped;
+                             continue;
+                         }
+                         window.push_back(inBuff[idx]);
+                         offsets.push_back(offset + idx);
+                     }
+                     frames(false);
+            }
+
+            if(!done && res.ok())
+                frames(true);
+            if(!done && res.ok()){
+                res.errOffset  =  offset;
+                res.errMsg     =  "Dtmf decoding: Truncated stream, last frame missing.";
+            }
+        }catch(...){
+            res.errMsg  =  "Dtmf decoding: Unexpected Error.";
+        }
+
+        if(!res.ok())
+            out.setstate(std::ios::failbit);
+    }
+
+} // End Namespace
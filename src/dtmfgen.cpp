@@ -0,0 +1,194 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::lock_guard;
+    using std::mutex;
+
+    namespace {
+
+        constexpr SineTable  sineTable;
+
+        // 32 bit phase increment: the table takes the upper 16 bits, the lower
+        // ones keep the frequency exact over long tones.
+        uint32_t phaseInc(int freq, size_t sSize) noexcept{
+            return static_cast<uint32_t>((static_cast<uint64_t>(freq) << 32) / sSize);
+        }
+
+    } // End Anonymous Namespace
+
+    constexpr size_t  ToneGenerator::BLOCK;
+
+    ToneGenerator::ToneGenerator(size_t sSize, const DtmfTiming& tm, SampleFormat fmt, bool whsound)
+     : sampleSize{ sSize },
+       timing(tm),
+       format{ fmt },
+       whiteSound{ whsound },
+       queued{ 0 },
+       phase1{ 0 },
+       phase2{ 0 },
+       errMsg{ "No error" }
+    {
+        if(sampleSize == 0)
+            throw string("ToneGenerator::ToneGenerator : invalid sample rate.");
+    }
+
+    size_t ToneGenerator::samples(size_t ms) const noexcept{
+        return (ms * sampleSize) / 1000;
+    }
+
+    bool ToneGenerator::push(char sym, size_t toneMs) noexcept{
+        try{
+            Step  tone { 0, 0, 0 };
+
+            if(sym == ' '){
+                tone.left  =  samples(toneMs != 0 ? toneMs : timing.pauseMs);
+            }else{
+                const char  key { static_cast<char>(std::toupper(static_cast<unsigned char>(sym))) };
+                for(size_t row{ 0 }; row < DTMF_FREQS; ++row)
+                    for(size_t col{ 0 }; col < DTMF_FREQS; ++col)
+                        if(dtmfKeypad[row][col] == key)
+                            tone  =  Step{ phaseInc(dtmfColFreq[col], sampleSize),
+                                           phaseInc(dtmfRowFreq[row], sampleSize),
+                                           samples(toneMs != 0 ? toneMs : timing.toneMs) };
+                if(tone.inc1 == 0){
+                    lock_guard<mutex>  guard(lock);
+                    errMsg  =  string("Invalid symbol: ").append(1, sym);
+                    return false;
+                }
+            }
+
+            const size_t       gap { whiteSound ? samples(timing.gapMs) : 0 };
+            lock_guard<mutex>  guard(lock);
+            if(tone.left != 0)
+                steps.push_back(tone);
+            if(gap != 0)
+                steps.push_back(Step{ 0, 0, gap });
+            queued  +=  tone.left + gap;
+        }catch(...){
+            lock_guard<mutex>  guard(lock);
+            errMsg  =  "ToneGenerator::push : Unexpected Error.";
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ToneGenerator::push(const char* const ch, size_t len) noexcept{
+        for(size_t idx{ 0 }; idx < len; ++idx)
+            if(!push(ch[idx]))
+                return false;
+
+        return true;
+    }
+
+    bool ToneGenerator::push(const string& str) noexcept{
+        return push(str.data(), str.size());
+    }
+
+    void ToneGenerator::synth(Step& st, float* out, size_t len) noexcept{
+        for(size_t idx{ 0 }; idx < len; ++idx){
+            out[idx]  =  (sineTable(static_cast<uint16_t>(phase1 >> 16)) +
+                          sineTable(static_cast<uint16_t>(phase2 >> 16))) * 0.5F;
+            phase1   +=  st.inc1;
+            phase2   +=  st.inc2;
+        }
+    }
+
+    void ToneGenerator::consumed(size_t len) noexcept{
+        queued                 -=  len;
+        steps.front().left     -=  len;
+        if(steps.front().left == 0)
+            steps.pop_front();
+    }
+
+    size_t ToneGenerator::fill(unsigned char* out, size_t frames) noexcept{
+        lock_guard<mutex>  guard(lock);
+        const size_t       bytes { sampleBytes(format) };
+        float              block[BLOCK];
+        size_t             done  { 0 };
+
+        while(done < frames && !steps.empty()){
+            Step&          st  { steps.front() };
+            const size_t   len { std::min(frames - done, st.left) };
+            unsigned char* dst { out + done * bytes };
+
+            if(st.inc1 == 0){
+                // Silence is the mid level, as in ToneBank.
+                std::fill(dst, dst + len * bytes, format == FORMAT_U8 ? 0x80 : 0);
+            }else{
+                for(size_t pos{ 0 }; pos < len; pos += BLOCK){
+                    const size_t  chunk { std::min(BLOCK, len - pos) };
+                    synth(st, block, chunk);
+                    convertSamples(block, chunk, format, dst + pos * bytes);
+                }
+            }
+
+            done  +=  len;
+            consumed(len);
+        }
+
+        return done;
+    }
+
+    size_t ToneGenerator::fill(float* out, size_t frames) noexcept{
+        lock_guard<mutex>  guard(lock);
+        size_t             done { 0 };
+
+        while(done < frames && !steps.empty()){
+            Step&         st  { steps.front() };
+            const size_t  len { std::min(frames - done, st.left) };
+
+            if(st.inc1 == 0)
+                std::fill(out + done, out + done + len, 0.0F);
+            else
+                synth(st, out + done, len);
+
+            done  +=  len;
+            consumed(len);
+        }
+
+        return done;
+    }
+
+    size_t ToneGenerator::pending(void) const noexcept{
+        lock_guard<mutex>  guard(lock);
+        return queued;
+    }
+
+    void ToneGenerator::reset(void) noexcept{
+        lock_guard<mutex>  guard(lock);
+        steps.clear();
+        queued  =  0;
+        phase1  =  phase2  =  0;
+    }
+
+    SampleFormat ToneGenerator::getFormat(void) const noexcept{
+        return format;
+    }
+
+    string ToneGenerator::getErrMsg(void) const{
+        lock_guard<mutex>  guard(lock);
+        return errMsg;
+    }
+
+} // End Namespace
@@ -0,0 +1,397 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cstring>
+#include <thread>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+    using std::to_string;
+    using std::ios;
+
+    namespace {
+
+        struct LaneCursor{
+            const string*         symbols;
+            size_t                next;         // Next symbol to play
+            const unsigned char*  pcm;          // Current tone or gap
+            size_t                left;         // Bytes of it still to play
+            bool                  gapDue;
+        };
+
+        // Writes up to frames samples of the lane, one every stride bytes of out,
+        // and silence past its end; returns the samples taken from the lane.
+        size_t fillLane(LaneCursor&      cur,
+                        const ToneBank&  bank,
+                        bool             whsound,
+                        unsigned char*   out,
+                        size_t           frames,
+                        size_t           stride) noexcept{
+            const size_t         bytes   { sampleBytes(bank.getFormat()) };
+            const unsigned char  silence { static_cast<unsigned char>(bank.getFormat() == FORMAT_U8 ? 0x80 : 0) };
+            size_t               done    { 0 };
+
+            while(done < frames){
+                if(cur.left < bytes){
+                    ToneSlot  sl { 0, 0 };
+                    if(cur.gapDue){
+                        sl          =  bank.gap();
+                        cur.gapDue  =  false;
+                    }else if(cur.next < cur.symbols->size()){
+                        sl          =  bank.slot((*cur.symbols)[cur.next++]);
+                        cur.gapDue  =  whsound;
+                        if(sl.offset == ToneBank::NO_TONE)
+                            continue;
+                    }else{
+                        break;
+                    }
+                    cur.pcm   =  bank.data(sl);
+                    cur.left  =  sl.length;
+                    continue;
+                }
+
+                const size_t  num { std::min(frames - done, cur.left / bytes) };
+                for(size_t idx{ 0 }; idx < num; ++idx)
+                    memcpy(out + (done + idx) * stride, cur.pcm + idx * bytes, bytes);
+                cur.pcm   +=  num * bytes;
+                cur.left  -=  num * bytes;
+                done      +=  num;
+            }
+
+            for(size_t idx{ done }; idx < frames; ++idx)
+                memset(out + idx * stride, silence, bytes);
+
+            return done;
+        }
+
+        size_t laneBytes(const LaneHeader& hdr) noexcept{
+            return hdr.length / hdr.lanes + (hdr.lane < hdr.length % hdr.lanes ? 1 : 0);
+        }
+
+    } // End Anonymous Namespace
+
+    void LaneHeader::encode(char* out) const noexcept{
+        unsigned char  bytes[BYTES] { static_cast<unsigned char>(lane),
+                                      static_cast<unsigned char>(lanes),
+                                      static_cast<unsigned char>(length & 0xFF),
+                                      static_cast<unsigned char>((length >> 8) & 0xFF),
+                                      static_cast<unsigned char>((length >> 16) & 0xFF),
+                                      static_cast<unsigned char>((length >> 24) & 0xFF),
+                                      0 };
+        unsigned       sum          { 0 };
+
+        for(size_t idx{ 0 }; idx < BYTES - 1; ++idx)
+            sum += bytes[idx];
+        bytes[BYTES - 1]  =  static_cast<unsigned char>(~sum);
+
+        BinFileToDtmf::encode(bytes, BYTES, out);
+    }
+
+    bool LaneHeader::decode(const char* in, size_t len, LaneHeader& hdr) noexcept{
+        unsigned char  bytes[BYTES];
+        unsigned       sum    { 0 };
+
+        if(len < SYMBOLS || DtmfToBinFile::decode(in, SYMBOLS, bytes) != SYMBOLS)
+            return false;
+        for(size_t idx{ 0 }; idx < BYTES - 1; ++idx)
+            sum += bytes[idx];
+        if(bytes[BYTES - 1] != static_cast<unsigned char>(~sum) || bytes[1] == 0 || bytes[0] >= bytes[1])
+            return false;
+
+        hdr.lane    =  bytes[0];
+        hdr.lanes   =  bytes[1];
+        hdr.length  =  static_cast<uint32_t>(bytes[2])       | static_cast<uint32_t>(bytes[3]) << 8 |
+                       static_cast<uint32_t>(bytes[4]) << 16 | static_cast<uint32_t>(bytes[5]) << 24;
+
+        return true;
+    }
+
+    LaneTransmitter::LaneTransmitter(vector<std::shared_ptr<AudioSink>> snks,
+                                     const DtmfTiming& tm, size_t sSize, bool whsound)
+       : sinks(std::move(snks)),
+         lanes{ 0 },
+         whiteSound{ whsound },
+         errMsg{ "No error" }
+    {
+        if(sinks.empty())
+            throw string("LaneTransmitter::LaneTransmitter : no audio sink.");
+
+        for(const auto& snk : sinks){
+            if(!snk)
+                throw string("LaneTransmitter::LaneTransmitter : invalid audio sink.");
+            if(snk->getFormat() != sinks.front()->getFormat())
+                throw string("LaneTransmitter::LaneTransmitter : sinks with different sample formats.");
+            lanes  +=  snk->getChannels();
+        }
+        if(lanes > LaneHeader::MAX_LANES)
+            throw string("LaneTransmitter::LaneTransmitter : too many lanes: ").append(to_string(lanes));
+
+        bank  =  std::make_shared<const ToneBank>(sSize, tm, tm.toneMs, sinks.front()->getFormat());
+    }
+
+    vector<string> LaneTransmitter::split(const unsigned char* data, size_t len, size_t lanes){
+        if(lanes == 0 || lanes > LaneHeader::MAX_LANES)
+            throw string("LaneTransmitter::split : invalid number of lanes: ").append(to_string(lanes));
+        if(len > UINT32_MAX)
+            throw string("LaneTransmitter::split : payload too long.");
+
+        vector<string>         streams(lanes);
+        vector<unsigned char>  bytes(len / lanes + 1);
+
+        for(size_t lane{ 0 }; lane < lanes; ++lane){
+            const LaneHeader  hdr   { lane, lanes, static_cast<uint32_t>(len) };
+            const size_t      count { laneBytes(hdr) };
+            string&           out   { streams[lane] };
+
+            for(size_t idx{ 0 }; idx < count; ++idx)
+                bytes[idx]  =  data[idx * lanes + lane];
+
+            out.resize(LaneHeader::SYMBOLS + count * 2);
+            hdr.encode(&out[0]);
+            BinFileToDtmf::encode(bytes.data(), count, &out[LaneHeader::SYMBOLS]);
+        }
+
+        return streams;
+    }
+
+    bool LaneTransmitter::send(const unsigned char* data, size_t len) const noexcept{
+        std::atomic<bool>  abort     { false };
+        std::mutex         errLock;
+        string             err;
+
+        try{
+            const vector<string>  streams { split(data, len, lanes) };
+            vector<std::thread>   workers;
+
+            // One thread per sink, interleaving the samples of its lanes.
+            auto  drive { [&](const AudioSink& snk, size_t first){
+                try{
+                    const size_t        chans   { snk.getChannels() },
+                                        bytes   { sampleBytes(bank->getFormat()) },
+                                        stride  { chans * bytes },
+                                        frames  { std::max<size_t>(bank->getSampleSize() / 4, 1) };
+                    vector<LaneCursor>  cursors;
+                    RawSoundArray       chunk(frames * stride);
+                    string              sinkErr;
+
+                    for(size_t ch{ 0 }; ch < chans; ++ch)
+                        cursors.push_back(LaneCursor{ &streams[first + ch], 0, nullptr, 0, false });
+
+                    while(!abort){
+                        size_t  used { 0 };
+                        for(size_t ch{ 0 }; ch < chans; ++ch)
+                            used  =  std::max(used, fillLane(cursors[ch], *bank, whiteSound,
+                                                             chunk.data() + ch * bytes, frames, stride));
+                        if(used == 0)
+                            break;
+                        if(!snk.play(chunk.data(), used * stride, sinkErr)){
+                            const std::lock_guard<std::mutex>  guard(errLock);
+                            if(err.empty())
+                                err  =  sinkErr;
+                            abort  =  true;
+                        }
+                    }
+                }catch(...){
+                    const std::lock_guard<std::mutex>  guard(errLock);
+                    if(err.empty())
+                        err  =  "LaneTransmitter::send : Unexpected Error.";
+                    abort  =  true;
+                }
+            } };
+
+            try{
+                for(size_t idx{ 0 }, first{ 0 }; idx < sinks.size(); first += sinks[idx]->getChannels(), ++idx)
+                    workers.emplace_back(drive, std::cref(*sinks[idx]), first);
+            }catch(...){
+                const std::lock_guard<std::mutex>  guard(errLock);
+                err    =  "LaneTransmitter::send : can't start the threads.";
+                abort  =  true;
+            }
+
+            for(auto& worker : workers)
+                worker.join();
+        }catch(string& ex){
+            err  =  ex;
+        }catch(...){
+            err  =  "LaneTransmitter::send : Unexpected Error.";
+        }
+
+        if(!err.empty()){
+            errMsg  =  err;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LaneTransmitter::sendFile(const string& fileName) const noexcept{
+        try{
+            std::ifstream  iFile(fileName, ios::in | ios::binary);
+            if(!iFile){
+                errMsg  =  string("LaneTransmitter::sendFile : can't open file: ").append(fileName);
+                return false;
+            }
+            const vector<unsigned char>  data { std::istreambuf_iterator<char>(iFile),
+                                                std::istreambuf_iterator<char>() };
+            return send(data.data(), data.size());
+        }catch(...){
+            errMsg  =  "LaneTransmitter::sendFile : Unexpected Error.";
+        }
+
+        return false;
+    }
+
+    size_t LaneTransmitter::getLanes(void) const noexcept{
+        return lanes;
+    }
+
+    const string& LaneTransmitter::getErrMsg(void) const noexcept{
+          return errMsg;
+    }
+
+    LaneReassembler::LaneReassembler(void) noexcept
+       : header{ 0, 0, 0 },
+         count{ 0 },
+         errMsg{ "No error" }
+    {}
+
+    bool LaneReassembler::add(const string& symbols) noexcept{
+        try{
+            const size_t  end  { symbols.find_last_not_of(" \t\r\n") + 1 };
+            LaneHeader    hdr  { 0, 0, 0 };
+
+            if(!LaneHeader::decode(symbols.data(), end, hdr)){
+                errMsg  =  "LaneReassembler::add : missing or corrupted lane header.";
+                return false;
+            }
+            if(count != 0 && (hdr.lanes != header.lanes || hdr.length != header.length)){
+                errMsg  =  string("LaneReassembler::add : lane ").append(to_string(hdr.lane))
+                           .append(" belongs to another transmission.");
+                return false;
+            }
+            if(count != 0 && received[hdr.lane]){
+                errMsg  =  string("LaneReassembler::add : lane ").append(to_string(hdr.lane))
+                           .append(" received twice.");
+                return false;
+            }
+
+            const size_t  bytes { laneBytes(hdr) };
+            if(end - LaneHeader::SYMBOLS != bytes * 2){
+                errMsg  =  string("LaneReassembler::add : lane ").append(to_string(hdr.lane))
+                           .append(" should hold ").append(to_string(bytes)).append(" bytes.");
+                return false;
+            }
+
+            vector<unsigned char>  payload(bytes);
+            const size_t           used { DtmfToBinFile::decode(symbols.data() + LaneHeader::SYMBOLS,
+                                                                bytes * 2, payload.data()) };
+            if(used != bytes * 2){
+                errMsg  =  string("LaneReassembler::add : lane ").append(to_string(hdr.lane))
+                           .append(", invalid symbol at offset: ")
+                           .append(to_string(LaneHeader::SYMBOLS + used));
+                return false;
+            }
+
+            if(count == 0){
+                header  =  hdr;
+                payloads.assign(hdr.lanes, vector<unsigned char>());
+                received.assign(hdr.lanes, false);
+            }
+            payloads[hdr.lane].swap(payload);
+            received[hdr.lane]  =  true;
+            ++count;
+        }catch(...){
+            errMsg  =  "LaneReassembler::add : Unexpected Error.";
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LaneReassembler::addFile(const string& fileName) noexcept{
+        try{
+            std::ifstream  iFile(fileName, ios::in | ios::binary);
+            if(!iFile){
+                errMsg  =  string("LaneReassembler::addFile : can't open file: ").append(fileName);
+                return false;
+            }
+            return add(string(std::istreambuf_iterator<char>(iFile), std::istreambuf_iterator<char>()));
+        }catch(...){
+            errMsg  =  "LaneReassembler::addFile : Unexpected Error.";
+        }
+
+        return false;
+    }
+
+    bool LaneReassembler::complete(void) const noexcept{
+        return count != 0 && count == header.lanes;
+    }
+
+    bool LaneReassembler::assemble(vector<unsigned char>& out) const noexcept{
+        if(!complete()){
+            errMsg  =  string("LaneReassembler::assemble : lanes missing, received ")
+                       .append(to_string(count)).append(" of ").append(to_string(header.lanes));
+            return false;
+        }
+
+        try{
+            out.resize(header.length);
+            for(size_t lane{ 0 }; lane < header.lanes; ++lane)
+                for(size_t idx{ 0 }; idx < payloads[lane].size(); ++idx)
+                    out[idx * header.lanes + lane]  =  payloads[lane][idx];
+        }catch(...){
+            errMsg  =  "LaneReassembler::assemble : Unexpected Error.";
+            return false;
+        }
+
+        return true;
+    }
+
+    bool LaneReassembler::saveTo(const string& outFile) const noexcept{
+        try{
+            vector<unsigned char>  data,
+                                   plain;
+            if(!assemble(data))
+                return false;
+            // A plain file starting with the magic doesn't unpack: kept as it is.
+            if(Packer::isPacked(data.data(), data.size()) && Packer::unpack(data.data(), data.size(), plain))
+                data.swap(plain);
+
+            std::ofstream  oFile(outFile, ios::out | ios::binary | ios::trunc);
+            oFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+            oFile.close();
+            if(!oFile){
+                errMsg  =  string("LaneReassembler::saveTo : can't write file: ").append(outFile);
+                return false;
+            }
+        }catch(...){
+            errMsg  =  "LaneReassembler::saveTo : Unexpected Error.";
+            return false;
+        }
+
+        return true;
+    }
+
+    const string& LaneReassembler::getErrMsg(void) const noexcept{
+          return errMsg;
+    }
+
+} // End Namespace
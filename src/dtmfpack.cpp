@@ -0,0 +1,568 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cstring>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+
+    namespace {
+
+        // The last byte of the magic is the method: packed or stored as it is,
+        // when packing doesn't pay off, e.g. with data already compressed.
+        constexpr unsigned char  PACK_MAGIC[3] { 'D', 'T', 'M' };
+        constexpr unsigned char  METHOD_LZ     { 'Z' };
+        constexpr unsigned char  METHOD_STORE  { 'S' };
+
+        constexpr size_t    MIN_MATCH   { 3 };
+        constexpr size_t    MAX_MATCH   { MIN_MATCH + 8 + 8 + 256 - 1 };
+        constexpr size_t    WINDOW      { 1U << 20 };
+        constexpr size_t    HASH_BITS   { 16 };
+        constexpr size_t    CHAIN_DEPTH { 48 };     // Candidates compared for every match
+        constexpr size_t    LAZY_LIMIT  { 32 };     // Longer matches are taken without looking ahead
+        constexpr uint32_t  NO_POS      { UINT32_MAX };
+        // The header length isn't trusted before the CRC: the output buffer
+        // starts at most this many times the packed data and grows as it's decoded.
+        constexpr size_t    RESERVE_RATIO { 16 };
+
+        constexpr unsigned  PROB_BITS   { 11 };
+        constexpr uint16_t  PROB_INIT   { 1U << (PROB_BITS - 1) };
+        constexpr unsigned  MOVE_BITS   { 5 };
+        constexpr uint32_t  TOP         { 1U << 24 };
+
+        // Distances are coded as LZMA does: a slot (the two top bits and the
+        // bit length), modelled footer bits up to END_SLOT, then direct bits
+        // and four modelled align bits.
+        constexpr unsigned  END_SLOT    { 14 };
+
+        using Prob  =  uint16_t;
+
+        struct LenModel{
+            Prob  choice,
+                  choice2,
+                  low[8],
+                  mid[8],
+                  high[256];
+        };
+
+        // Adaptive probabilities of every decision, the same on both sides.
+        struct Model{
+            Prob      isMatch[2],
+                      isRep[2],
+                      literal[8][0x100],
+                      slot[4][64],
+                      footer[115],
+                      align[16];
+            LenModel  len,
+                      repLen;
+
+            Model(void) noexcept{
+                std::fill_n(isMatch, 2, PROB_INIT);
+                std::fill_n(isRep, 2, PROB_INIT);
+                std::fill_n(&literal[0][0], 8 * 0x100, PROB_INIT);
+                std::fill_n(&slot[0][0], 4 * 64, PROB_INIT);
+                std::fill_n(footer, 115, PROB_INIT);
+                std::fill_n(align, 16, PROB_INIT);
+                for(LenModel* lm : { &len, &repLen }){
+                    lm->choice   =  lm->choice2  =  PROB_INIT;
+                    std::fill_n(lm->low, 8, PROB_INIT);
+                    std::fill_n(lm->mid, 8, PROB_INIT);
+                    std::fill_n(lm->high, 256, PROB_INIT);
+                }
+            }
+        };
+
+        unsigned distSlot(uint32_t dist) noexcept{
+            if(dist < 4)
+                return dist;
+
+            unsigned  bits { 31 };
+            while((dist >> bits) == 0)
+                --bits;
+
+            return 2 * bits + ((dist >> (bits - 1)) & 1);
+        }
+
+        class RangeEncoder{
+            public:
+                explicit RangeEncoder(vector<unsigned char>& dest) noexcept
+                   : out(dest),
+                     low{ 0 },
+                     range{ 0xFFFFFFFF },
+                     cache{ 0 },
+                     cacheSize{ 1 }
+                {}
+
+                void bit(Prob& prob, unsigned val){
+                    const uint32_t  bound { (range >> PROB_BITS) * prob };
+                    if(val == 0){
+                        range   =  bound;
+                        prob   +=  ((1U << PROB_BITS) - prob) >> MOVE_BITS;
+                    }else{
+                        low    +=  bound;
+                        range  -=  bound;
+                        prob   -=  prob >> MOVE_BITS;
+                    }
+                    normalize();
+                }
+
+                void direct(uint32_t val, unsigned bits){
+                    while(bits-- > 0){
+                        range  >>=  1;
+                        if((val >> bits) & 1)
+                            low  +=  range;
+                        normalize();
+                    }
+                }
+
+                void tree(Prob* probs, unsigned bits, unsigned val){
+                    unsigned  node { 1 };
+                    while(bits-- > 0){
+                        const unsigned  bitVal { (val >> bits) & 1 };
+                        bit(probs[node], bitVal);
+                        node  =  (node << 1) | bitVal;
+                    }
+                }
+
+                void reverseTree(Prob* probs, unsigned bits, unsigned val){
+                    unsigned  node { 1 };
+                    for(; bits > 0; --bits, val >>= 1){
+                        bit(probs[node], val & 1);
+                        node  =  (node << 1) | (val & 1);
+                    }
+                }
+
+                void flush(void){
+                    for(int idx{ 0 }; idx < 5; ++idx)
+                        shiftLow();
+                }
+
+            private:
+                vector<unsigned char>&  out;
+                uint64_t                low;
+                uint32_t                range;
+                unsigned char           cache;
+                uint64_t                cacheSize;
+
+                void normalize(void){
+                    while(range < TOP){
+                        range  <<=  8;
+                        shiftLow();
+                    }
+                }
+
+                // Bytes are delayed while a carry may still change them.
+                void shiftLow(void){
+                    if(static_cast<uint32_t>(low) < 0xFF000000U || (low >> 32) != 0){
+                        const unsigned char  carry { static_cast<unsigned char>(low >> 32) };
+                        unsigned char        temp  { cache };
+                        do{
+                            out.push_back(static_cast<unsigned char>(temp + carry));
+                            temp  =  0xFF;
+                        }while(--cacheSize != 0);
+                        cache  =  static_cast<unsigned char>(low >> 24);
+                    }
+                    ++cacheSize;
+                    low  =  (low & 0x00FFFFFF) << 8;
+                }
+        };
+
+        class RangeDecoder{
+            public:
+                RangeDecoder(const unsigned char* data, size_t len) noexcept
+                   : in{ data },
+                     end{ data + len },
+                     range{ 0xFFFFFFFF },
+                     code{ 0 },
+                     overrun{ 0 }
+                {
+                    for(int idx{ 0 }; idx < 5; ++idx)
+                        code  =  (code << 8) | next();
+                }
+
+                unsigned bit(Prob& prob) noexcept{
+                    const uint32_t  bound { (range >> PROB_BITS) * prob };
+                    unsigned        val   { 0 };
+                    if(code < bound){
+                        range   =  bound;
+                        prob   +=  ((1U << PROB_BITS) - prob) >> MOVE_BITS;
+                    }else{
+                        code   -=  bound;
+                        range  -=  bound;
+                        prob   -=  prob >> MOVE_BITS;
+                        val     =  1;
+                    }
+                    normalize();
+                    return val;
+                }
+
+                uint32_t direct(unsigned bits) noexcept{
+                    uint32_t  val { 0 };
+                    while(bits-- > 0){
+                        range  >>=  1;
+                        const unsigned  bitVal { code >= range ? 1U : 0U };
+                        code  -=  range & (0U - bitVal);
+                        val    =  (val << 1) | bitVal;
+                        normalize();
+                    }
+                    return val;
+                }
+
+                unsigned tree(Prob* probs, unsigned bits) noexcept{
+                    unsigned  node { 1 };
+                    for(unsigned idx{ 0 }; idx < bits; ++idx)
+                        node  =  (node << 1) | bit(probs[node]);
+                    return node - (1U << bits);
+                }
+
+                unsigned reverseTree(Prob* probs, unsigned bits) noexcept{
+                    unsigned  node { 1 },
+                              val  { 0 };
+                    for(unsigned idx{ 0 }; idx < bits; ++idx){
+                        const unsigned  bitVal { bit(probs[node]) };
+                        node  =  (node << 1) | bitVal;
+                        val  |=  bitVal << idx;
+                    }
+                    return val;
+                }
+
+                // The encoder flushes five bytes, so a valid stream never reads past its end.
+                bool overran(void)                                 const noexcept{
+                    return overrun > 0;
+                }
+
+            private:
+                const unsigned char*  in;
+                const unsigned char*  end;
+                uint32_t              range,
+                                      code;
+                size_t                overrun;
+
+                uint32_t next(void) noexcept{
+                    if(in < end)
+                        return *in++;
+                    ++overrun;
+                    return 0;
+                }
+
+                void normalize(void) noexcept{
+                    if(range < TOP){
+                        range  <<=  8;
+                        code    =  (code << 8) | next();
+                    }
+                }
+        };
+
+        void encodeLen(RangeEncoder& enc, LenModel& lm, size_t len){
+            const unsigned  val { static_cast<unsigned>(len - MIN_MATCH) };
+            if(val < 8){
+                enc.bit(lm.choice, 0);
+                enc.tree(lm.low, 3, val);
+            }else if(val < 16){
+                enc.bit(lm.choice, 1);
+                enc.bit(lm.choice2, 0);
+                enc.tree(lm.mid, 3, val - 8);
+            }else{
+                enc.bit(lm.choice, 1);
+                enc.bit(lm.choice2, 1);
+                enc.tree(lm.high, 8, val - 16);
+            }
+        }
+
+        size_t decodeLen(RangeDecoder& dec, LenModel& lm) noexcept{
+            if(dec.bit(lm.choice) == 0)
+                return MIN_MATCH + dec.tree(lm.low, 3);
+            if(dec.bit(lm.choice2) == 0)
+                return MIN_MATCH + 8 + dec.tree(lm.mid, 3);
+            return MIN_MATCH + 16 + dec.tree(lm.high, 8);
+        }
+
+        void encodeDist(RangeEncoder& enc, Model& model, uint32_t dist, size_t len){
+            const unsigned  slot { distSlot(dist) };
+            enc.tree(model.slot[std::min<size_t>(len - MIN_MATCH, 3)], 6, slot);
+            if(slot < 4)
+                return;
+
+            const unsigned  bits { (slot >> 1) - 1 };
+            const uint32_t  base { (2U | (slot & 1)) << bits },
+                            rest { dist - base };
+            if(slot < END_SLOT){
+                enc.reverseTree(model.footer + base - slot, bits, rest);
+            }else{
+                enc.direct(rest >> 4, bits - 4);
+                enc.reverseTree(model.align, 4, rest & 0x0F);
+            }
+        }
+
+        uint32_t decodeDist(RangeDecoder& dec, Model& model, size_t len) noexcept{
+            const unsigned  slot { dec.tree(model.slot[std::min<size_t>(len - MIN_MATCH, 3)], 6) };
+            if(slot < 4)
+                return slot;
+
+            const unsigned  bits { (slot >> 1) - 1 };
+            const uint32_t  base { (2U | (slot & 1)) << bits };
+            if(slot < END_SLOT)
+                return base + dec.reverseTree(model.footer + base - slot, bits);
+
+            const uint32_t  high { dec.direct(bits - 4) };
+            return base + (high << 4) + dec.reverseTree(model.align, 4);
+        }
+
+        // Hash chains over three bytes, in a window of WINDOW bytes.
+        class MatchFinder{
+            public:
+                MatchFinder(const unsigned char* data, size_t len)
+                   : in{ data },
+                     size{ len },
+                     head(1U << HASH_BITS, NO_POS),
+                     prev(len, NO_POS)
+                {}
+
+                // Longest match at pos, before pos is inserted; 0 if none.
+                size_t find(size_t pos, uint32_t& dist)            const noexcept{
+                    const size_t  limit { std::min(MAX_MATCH, size - pos) };
+                    size_t        best  { 0 };
+                    if(limit < MIN_MATCH)
+                        return 0;
+
+                    uint32_t  cand { head[hash(pos)] };
+                    for(size_t depth{ CHAIN_DEPTH }; cand != NO_POS && pos - cand <= WINDOW && depth > 0;
+                        --depth, cand = prev[cand]){
+                        if(in[cand + best] != in[pos + best])
+                            continue;
+                        size_t  len { 0 };
+                        while(len < limit && in[cand + len] == in[pos + len])
+                            ++len;
+                        if(len > best){
+                            best  =  len;
+                            dist  =  static_cast<uint32_t>(pos - cand - 1);
+                            if(len == limit)
+                                break;
+                        }
+                    }
+
+                    return best >= MIN_MATCH ? best : 0;
+                }
+
+                size_t length(size_t pos, uint32_t dist)           const noexcept{
+                    if(pos <= dist)
+                        return 0;
+                    const size_t  limit { std::min(MAX_MATCH, size - pos) };
+                    size_t        len   { 0 };
+                    while(len < limit && in[pos - dist - 1 + len] == in[pos + len])
+                        ++len;
+                    return len >= MIN_MATCH ? len : 0;
+                }
+
+                void insert(size_t pos) noexcept{
+                    if(pos + MIN_MATCH > size)
+                        return;
+                    uint32_t&  first { head[hash(pos)] };
+                    prev[pos]  =  first;
+                    first      =  static_cast<uint32_t>(pos);
+                }
+
+            private:
+                const unsigned char*  in;
+                size_t                size;
+                vector<uint32_t>      head,
+                                      prev;
+
+                uint32_t hash(size_t pos)                          const noexcept{
+                    const uint32_t  val { static_cast<uint32_t>(in[pos]) << 16 |
+                                          static_cast<uint32_t>(in[pos + 1]) << 8 | in[pos + 2] };
+                    return (val * 2654435761U) >> (32 - HASH_BITS);
+                }
+        };
+
+        uint32_t crc32(const unsigned char* data, size_t len) noexcept{
+            static const std::array<uint32_t, 256>  table { [](){
+                std::array<uint32_t, 256>  tbl {};
+                for(uint32_t idx{ 0 }; idx < 256; ++idx){
+                    uint32_t  val { idx };
+                    for(int bit{ 0 }; bit < 8; ++bit)
+                        val  =  val & 1 ? (val >> 1) ^ 0xEDB88320U : val >> 1;
+                    tbl[idx]  =  val;
+                }
+                return tbl;
+            }() };
+
+            uint32_t  crc { 0xFFFFFFFFU };
+            for(size_t idx{ 0 }; idx < len; ++idx)
+                crc  =  table[(crc ^ data[idx]) & 0xFF] ^ (crc >> 8);
+
+            return ~crc;
+        }
+
+        void putLe32(vector<unsigned char>& out, uint32_t val){
+            for(int shift{ 0 }; shift < 32; shift += 8)
+                out.push_back(static_cast<unsigned char>(val >> shift));
+        }
+
+        uint32_t getLe32(const unsigned char* in) noexcept{
+            return static_cast<uint32_t>(in[0])       | static_cast<uint32_t>(in[1]) << 8 |
+                   static_cast<uint32_t>(in[2]) << 16 | static_cast<uint32_t>(in[3]) << 24;
+        }
+
+    } // End Anonymous Namespace
+
+    void Packer::pack(const unsigned char* in, size_t len, vector<unsigned char>& out){
+        if(len > UINT32_MAX)
+            throw string("Packer::pack : input too long.");
+
+        out.assign(PACK_MAGIC, PACK_MAGIC + sizeof(PACK_MAGIC));
+        out.push_back(METHOD_LZ);
+        putLe32(out, static_cast<uint32_t>(len));
+        putLe32(out, crc32(in, len));
+
+        std::unique_ptr<Model>  model(new Model);
+        RangeEncoder            enc(out);
+        MatchFinder             finder(in, len);
+        uint32_t                rep0  { 0 };
+        unsigned                state { 0 };           // 1 after a match
+
+        size_t                  ahead     { 0 };        // Match found by the lazy look ahead
+        uint32_t                aheadDist { 0 };
+        bool                    lookedUp  { false };
+
+        for(size_t pos{ 0 }; pos < len; ){
+            uint32_t      dist   { aheadDist };
+            size_t        best   { lookedUp ? ahead : finder.find(pos, dist) };
+            const size_t  repLen { finder.length(pos, rep0) };
+            finder.insert(pos);
+            lookedUp  =  false;
+
+            // Lazy matching: a literal, if the next position has a longer match.
+            if(best != 0 && best < LAZY_LIMIT && repLen < best){
+                ahead     =  finder.find(pos + 1, aheadDist);
+                lookedUp  =  ahead > best + 1;
+                if(lookedUp)
+                    best  =  0;
+            }
+
+            const bool  useRep { !lookedUp && repLen != 0 && repLen + 1 >= best };
+            if(best == 0 && !useRep){
+                enc.bit(model->isMatch[state], 0);
+                enc.tree(model->literal[pos > 0 ? in[pos - 1] >> 5 : 0], 8, in[pos]);
+                state  =  0;
+                ++pos;
+                continue;
+            }
+
+            enc.bit(model->isMatch[state], 1);
+            if(useRep){
+                best  =  repLen;
+                enc.bit(model->isRep[state], 1);
+                encodeLen(enc, model->repLen, best);
+            }else{
+                enc.bit(model->isRep[state], 0);
+                encodeLen(enc, model->len, best);
+                encodeDist(enc, *model, dist, best);
+                rep0  =  dist;
+            }
+            state  =  1;
+
+            for(size_t idx{ 1 }; idx < best; ++idx)
+                finder.insert(pos + idx);
+            pos  +=  best;
+        }
+
+        enc.flush();
+
+        if(out.size() > HEADER + len){
+            out[sizeof(PACK_MAGIC)]  =  METHOD_STORE;
+            out.resize(HEADER);
+            out.insert(out.end(), in, in + len);
+        }
+    }
+
+    void Packer::packStream(std::istream& in, vector<unsigned char>& out){
+        vector<unsigned char>  data;
+        char                   buff[1U << 16];
+
+        while(in.read(buff, sizeof(buff)) || in.gcount() > 0){
+            const size_t  got { static_cast<size_t>(in.gcount()) };
+            if(data.size() + got > UINT32_MAX)
+                throw string("Packer::packStream : input over 4 GB, too long to compress.");
+            data.insert(data.end(), buff, buff + got);
+        }
+        if(in.bad())
+            throw string("Packer::packStream : read error.");
+
+        pack(data.data(), data.size(), out);
+    }
+
+    bool Packer::isPacked(const unsigned char* in, size_t len) noexcept{
+        return len >= HEADER && memcmp(in, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0 &&
+               (in[sizeof(PACK_MAGIC)] == METHOD_LZ || in[sizeof(PACK_MAGIC)] == METHOD_STORE);
+    }
+
+    bool Packer::unpack(const unsigned char* in, size_t len, vector<unsigned char>& out) noexcept{
+        if(!isPacked(in, len))
+            return false;
+
+        try{
+            const uint32_t          size  { getLe32(in + 4) },
+                                    crc   { getLe32(in + 8) };
+            std::unique_ptr<Model>  model(new Model);
+            RangeDecoder            dec(in + HEADER, len - HEADER);
+            uint32_t                rep0  { 0 };
+            unsigned                state { 0 };
+
+            if(in[sizeof(PACK_MAGIC)] == METHOD_STORE){
+                out.assign(in + HEADER, in + len);
+                return out.size() == size && crc32(out.data(), out.size()) == crc;
+            }
+
+            out.clear();
+            out.reserve(std::min<size_t>(size, (len - HEADER) * RESERVE_RATIO));
+            while(out.size() < size && !dec.overran()){
+                if(dec.bit(model->isMatch[state]) == 0){
+                    const unsigned char  ctx { static_cast<unsigned char>(out.empty() ? 0 : out.back() >> 5) };
+                    out.push_back(static_cast<unsigned char>(dec.tree(model->literal[ctx], 8)));
+                    state  =  0;
+                    continue;
+                }
+
+                size_t  count { 0 };
+                if(dec.bit(model->isRep[state]) != 0){
+                    count  =  decodeLen(dec, model->repLen);
+                }else{
+                    count  =  decodeLen(dec, model->len);
+                    rep0   =  decodeDist(dec, *model, count);
+                }
+                state  =  1;
+
+                if(rep0 >= out.size() || count > size - out.size())
+                    return false;
+                for(size_t src{ out.size() - rep0 - 1 }; count > 0; --count, ++src){
+                    const unsigned char  byte { out[src] };
+                    out.push_back(byte);
+                }
+            }
+
+            return out.size() == size && !dec.overran() && crc32(out.data(), out.size()) == crc;
+        }catch(...){
+            return false;
+        }
+    }
+
+} // End Namespace
@@ -0,0 +1,378 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::ofstream;
+    using std::ios;
+
+    namespace {
+
+        // The RIFF size, 36 header bytes, the data and its pad byte, is 32 bit.
+        constexpr uint32_t  MAX_WAV_DATA { UINT32_MAX - 36 - 1 };
+
+        void writeLe16(ofstream& out, uint16_t val){
+            const char buff[2] { static_cast<char>(val & 0xFF),
+                                 static_cast<char>((val >> 8) & 0xFF) };
+            out.write(buff, sizeof(buff));
+        }
+
+        void writeLe32(ofstream& out, uint32_t val){
+            writeLe16(out, static_cast<uint16_t>(val & 0xFFFF));
+            writeLe16(out, static_cast<uint16_t>(val >> 16));
+        }
+
+    } // End Anonymous Namespace
+
+    SampleFormat formatFromName(const string& name){
+        if(name == "u8")       return FORMAT_U8;
+        if(name == "s16")      return FORMAT_S16_LE;
+        if(name == "float")    return FORMAT_FLOAT;
+
+        throw string("formatFromName : invalid sample format: ").append(name);
+    }
+
+    void convertSamples(const float* in, size_t len, SampleFormat fmt, unsigned char* out) noexcept{
+        size_t idx { 0 };
+
+        switch(fmt){
+            case FORMAT_U8:
+                for(; idx < len; ++idx)
+                    out[idx]  =  static_cast<unsigned char>((in[idx] + 1.0F) * 127.0F);
+            break;
+            case FORMAT_S16_LE:
+#if defined(__SSE2__)
+                // Eight samples per step, saturated by the pack instruction.
+                for(const __m128 scale { _mm_set1_ps(32767.0F) }; idx + 8 <= len; idx += 8){
+                    const __m128i lo { _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + idx),     scale)) },
+                                  hi { _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + idx + 4), scale)) };
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + idx * 2), _mm_packs_epi32(lo, hi));
+                }
+#endif
+                for(; idx < len; ++idx){
+                    const float   clip { std::max(-1.0F, std::min(1.0F, in[idx])) };
+                    const int16_t val  { static_cast<int16_t>(lrintf(clip * 32767.0F)) };
+                    out[idx * 2]      =  static_cast<unsigned char>(val & 0xFF);
+                    out[idx * 2 + 1]  =  static_cast<unsigned char>((val >> 8) & 0xFF);
+                }
+            break;
+            case FORMAT_FLOAT:
+                memcpy(out, in, len * sizeof(float));
+            break;
+        }
+    }
+
+    PlayJob::PlayJob(RawSoundArray&& data, PlayCallback&& cb)
+       : pcm(std::move(data)),
+         callback(std::move(cb)),
+         cancelled{ false },
+         status{ PLAY_PENDING },
+         result(promise.get_future().share())
+    {}
+
+    void PlayJob::finish(PlayStatus st, const string& err) noexcept{
+        if(status != PLAY_PENDING)
+            return;
+
+        try{
+            errMsg  =  err;
+            status  =  st;
+            promise.set_value(st);
+            if(callback)
+                callback(st, errMsg);
+        }catch(...){}
+    }
+
+    PlayHandle::PlayHandle(std::shared_ptr<PlayJob> jb) noexcept
+       : job{ std::move(jb) }
+    {}
+
+    void PlayHandle::cancel(void) const noexcept{
+        if(job)
+            job->cancelled  =  true;
+    }
+
+    PlayStatus PlayHandle::status(void) const noexcept{
+        return job ? job->status.load() : PLAY_FAILED;
+    }
+
+    PlayStatus PlayHandle::wait(void) const{
+        return job ? job->result.get() : PLAY_FAILED;
+    }
+
+    std::shared_future<PlayStatus> PlayHandle::future(void) const{
+        return job ? job->result : std::shared_future<PlayStatus>();
+    }
+
+    const string& PlayHandle::getErrMsg(void) const noexcept{
+        static const string  noJob { "PlayHandle : no job." };
+        return job ? job->errMsg : noJob;
+    }
+
+    AudioSink::AudioSink(SampleFormat fmt, size_t chans) noexcept
+       : format{ fmt },
+         channels{ std::max<size_t>(chans, 1) }
+    {}
+
+    bool AudioSink::play(const RawSoundArray& arr, string& errmsg) const noexcept{
+        return play(arr.data(), arr.size(), errmsg);
+    }
+
+    bool AudioSink::play(ToneGenerator& gen, string& errmsg) const noexcept{
+        if(channels != 1 || gen.getFormat() != format){
+            errmsg  =  "AudioSink::play : the generator doesn't match the sink.";
+            return false;
+        }
+
+        try{
+            const size_t   bytes  { sampleBytes(format) },
+                           period { std::max<size_t>(getPeriod(), 1) };
+            RawSoundArray  buff(period * bytes);
+            for(size_t len; (len = gen.fill(buff.data(), period)) != 0; )
+                if(!play(buff.data(), len * bytes, errmsg))
+                    return false;
+        }catch(...){
+            errmsg  =  "AudioSink::play : Unexpected Error.";
+            return false;
+        }
+
+        return true;
+    }
+
+    size_t AudioSink::getPeriod(void) const noexcept{
+        return 1024;
+    }
+
+    PlayStats AudioSink::getStats(void) const noexcept{
+        return PlayStats{};
+    }
+
+    double PlayStats::symbolRate(void) const noexcept{
+        return seconds > 0.0 ? static_cast<double>(symbols) / seconds : 0.0;
+    }
+
+    std::ostream& operator<< (std::ostream& out, const PlayStats& stats){
+        const std::ios::fmtflags  flags     { out.flags() };
+        const std::streamsize     precision { out.precision() };
+
+        out << "Symbols played:   " << stats.symbols << '\n'
+            << "Symbol rate:      " << std::fixed << std::setprecision(2) << stats.symbolRate() << " /s\n"
+            << "Frames written:   " << stats.frames << '\n'
+            << "Writes:           " << stats.writes << '\n'
+            << "Xruns recovered:  " << stats.xruns << '\n'
+            << "Short writes:     " << stats.shortWrites << '\n'
+            << "Failed writes:    " << stats.failures << '\n'
+            << "Max write (us):   " << stats.maxLatencyUs << '\n';
+
+        for(size_t idx{ 0 }; idx < PlayStats::LATENCY_BUCKETS; ++idx){
+            if(stats.latency[idx] == 0)
+                continue;
+            if(idx + 1 < PlayStats::LATENCY_BUCKETS)
+                out << "Writes < " << std::setw(8) << (1ULL << idx) << " us: " << stats.latency[idx] << '\n';
+            else
+                out << "Writes >= " << std::setw(7) << (1ULL << (idx - 1)) << " us: " << stats.latency[idx] << '\n';
+        }
+        out.flags(flags);
+        out.precision(precision);
+
+        return out;
+    }
+
+    PlayCounters::PlayCounters(void) noexcept
+       : writes{ 0 },
+         frames{ 0 },
+         xruns{ 0 },
+         shortWrites{ 0 },
+         failures{ 0 },
+         maxLatencyUs{ 0 }
+    {
+        for(auto& bucket : latency)
+            bucket  =  0;
+    }
+
+    void PlayCounters::write(uint64_t requested, long written, uint64_t micros) noexcept{
+        if(written == -EAGAIN)                          // Nothing done, the caller waits
+            return;
+
+        size_t  bucket { 0 };
+        while(bucket + 1 < PlayStats::LATENCY_BUCKETS && micros >= (1ULL << bucket))
+            ++bucket;
+
+        ++writes;
+        ++latency[bucket];
+        for(uint64_t prev { maxLatencyUs }; micros > prev && !maxLatencyUs.compare_exchange_weak(prev, micros); ){}
+
+        if(written > 0)
+            frames  +=  static_cast<uint64_t>(written);
+        if(written == 0 || (written > 0 && static_cast<uint64_t>(written) < requested))
+            ++shortWrites;
+    }
+
+    void PlayCounters::xrun(void) noexcept{
+        ++xruns;
+    }
+
+    void PlayCounters::failure(void) noexcept{
+        ++failures;
+    }
+
+    PlayStats PlayCounters::snapshot(void) const noexcept{
+        PlayStats  stats {};
+        stats.writes        =  writes;
+        stats.frames        =  frames;
+        stats.xruns         =  xruns;
+        stats.shortWrites   =  shortWrites;
+        stats.failures      =  failures;
+        stats.maxLatencyUs  =  maxLatencyUs;
+        for(size_t idx{ 0 }; idx < PlayStats::LATENCY_BUCKETS; ++idx)
+            stats.latency[idx]  =  latency[idx];
+
+        return stats;
+    }
+
+    PlayHandle AudioSink::submit(RawSoundArray pcm, PlayCallback cb) const{
+        auto    job { std::make_shared<PlayJob>(std::move(pcm), std::move(cb)) };
+        string  err;
+
+        job->finish(play(job->pcm, err) ? PLAY_DONE : PLAY_FAILED, err);
+
+        return PlayHandle(job);
+    }
+
+    SampleFormat AudioSink::getFormat(void) const noexcept{
+        return format;
+    }
+
+    size_t AudioSink::getChannels(void) const noexcept{
+        return channels;
+    }
+
+    RawFileSink::RawFileSink(const string& fileName, SampleFormat fmt, size_t chans)
+       : AudioSink(fmt, chans),
+         oFile(fileName, ios::out | ios::binary | ios::trunc)
+    {
+        if(!oFile)
+            throw string("RawFileSink::RawFileSink : can't open file: ").append(fileName);
+    }
+
+    RawFileSink::~RawFileSink(void){
+           oFile.close();
+    }
+
+    bool RawFileSink::play(const unsigned char* data, size_t len, string& errmsg) const noexcept{
+        oFile.write(reinterpret_cast<const char*>(data), len);
+        if(!oFile){
+            errmsg = "RawFileSink::play : write failed.";
+            return false;
+        }
+        return true;
+    }
+
+    WavFileSink::WavFileSink(const string& fileName, size_t sSize, SampleFormat fmt, size_t chans)
+       : AudioSink(fmt, chans),
+         oFile(fileName, ios::out | ios::binary | ios::trunc),
+         dataLen{ 0 },
+         sampleSize{ sSize }
+    {
+        if(!oFile)
+            throw string("WavFileSink::WavFileSink : can't open file: ").append(fileName);
+
+        const uint16_t bytes { static_cast<uint16_t>(sampleBytes(format)) },
+                       align { static_cast<uint16_t>(bytes * channels) };
+
+        // Sizes are patched by close(), once the length of the data is known.
+        oFile.write("RIFF", 4);
+        writeLe32(oFile, 0);
+        oFile.write("WAVEfmt ", 8);
+        writeLe32(oFile, 16);
+        writeLe16(oFile, format == FORMAT_FLOAT ? 3 : 1);       // IEEE float or PCM
+        writeLe16(oFile, static_cast<uint16_t>(channels));
+        writeLe32(oFile, static_cast<uint32_t>(sampleSize));
+        writeLe32(oFile, static_cast<uint32_t>(sampleSize * align));
+        writeLe16(oFile, align);                                // Block align
+        writeLe16(oFile, bytes * 8);                            // Bits per sample
+        oFile.write("data", 4);
+        writeLe32(oFile, 0);
+    }
+
+    WavFileSink::~WavFileSink(void){
+           close();
+    }
+
+    void WavFileSink::close(void) noexcept{
+        if(!oFile.is_open())
+            return;
+
+        try{
+            if(dataLen & 1)
+                oFile.put(0);
+            oFile.seekp(4, ios::beg);
+            writeLe32(oFile, 36 + dataLen + (dataLen & 1));
+            oFile.seekp(40, ios::beg);
+            writeLe32(oFile, dataLen);
+            oFile.close();
+        }catch(...){}
+    }
+
+    bool WavFileSink::play(const unsigned char* data, size_t len, string& errmsg) const noexcept{
+        if(len > MAX_WAV_DATA - dataLen){
+            errmsg = "WavFileSink::play : the WAV file would pass its 4 GB limit.";
+            return false;
+        }
+        oFile.write(reinterpret_cast<const char*>(data), len);
+        if(!oFile){
+            errmsg = "WavFileSink::play : write failed.";
+            return false;
+        }
+        dataLen += static_cast<uint32_t>(len);
+        return true;
+    }
+
+    MemorySink::MemorySink(SampleFormat fmt, size_t chans) noexcept
+       : AudioSink(fmt, chans)
+    {}
+
+    bool MemorySink::play(const unsigned char* buff, size_t len, string& errmsg) const noexcept{
+        try{
+            data.insert(data.end(), buff, buff + len);
+        }catch(...){
+            errmsg = "MemorySink::play : out of memory.";
+            return false;
+        }
+        return true;
+    }
+
+    const RawSoundArray& MemorySink::getData(void) const noexcept{
+          return data;
+    }
+
+    void MemorySink::clear(void) noexcept{
+          data.clear();
+    }
+
+} // End Namespace
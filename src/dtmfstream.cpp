@@ -0,0 +1,238 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+    using std::endl;
+
+    namespace {
+
+        constexpr size_t  STREAM_SYMBOLS  { 4096 };     // Symbols read ahead of the renderer
+        constexpr size_t  STREAM_AHEAD_MS { 500  };     // Audio rendered ahead of the sink
+        constexpr size_t  STREAM_WRITE_MS { 50   };     // Largest single write to the sink
+        constexpr int     STREAM_POLL_MS  { 100  };
+
+        // Waiting side of the rings: spin briefly, then sleep, so an idle
+        // stream doesn't keep a core busy.
+        void backoff(unsigned& spins) noexcept{
+            if(++spins < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+    } // End Anonymous Namespace
+
+    ByteRing::ByteRing(size_t cap)
+       : mask{ 0 },
+         head{ 0 },
+         tail{ 0 }
+    {
+        size_t size { 1 };
+        while(size < cap)
+            size <<= 1;
+        buff.resize(size);
+        mask  =  size - 1;
+    }
+
+    size_t ByteRing::write(const unsigned char* data, size_t len) noexcept{
+        const size_t  pos  { head.load(std::memory_order_relaxed) },
+                      free { buff.size() - (pos - tail.load(std::memory_order_acquire)) },
+                      num  { std::min(len, free) },
+                      part { std::min(num, buff.size() - (pos & mask)) };
+
+        memcpy(&buff[pos & mask], data, part);
+        memcpy(buff.data(), data + part, num - part);
+        head.store(pos + num, std::memory_order_release);
+
+        return num;
+    }
+
+    size_t ByteRing::read(unsigned char* data, size_t len) noexcept{
+        const size_t  pos  { tail.load(std::memory_order_relaxed) },
+                      num  { std::min(len, head.load(std::memory_order_acquire) - pos) },
+                      part { std::min(num, buff.size() - (pos & mask)) };
+
+        memcpy(data, &buff[pos & mask], part);
+        memcpy(data + part, buff.data(), num - part);
+        tail.store(pos + num, std::memory_order_release);
+
+        return num;
+    }
+
+    size_t ByteRing::readable(void) const noexcept{
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t ByteRing::capacity(void) const noexcept{
+        return buff.size();
+    }
+
+    bool Dtmf::playStream(int fd, std::ostream* log) const noexcept{
+       if(!bank){
+           errMsg  =  "Dtmf::playStream : tones not initialized, call init().";
+           return false;
+       }
+
+       const auto         start       { std::chrono::steady_clock::now() };
+       const size_t       bytes       { sampleBytes(bank->getFormat()) },
+                          rate        { bank->getSampleSize() };
+       size_t             rendered    { 0 };
+       std::atomic<bool>  readDone    { false },
+                          renderDone  { false },
+                          abort       { false };
+       std::mutex         logLock;
+       string             readErr,
+                          writeErr;
+
+       symbolsSkipped  =  0;
+
+       try{
+           ByteRing               symbols(STREAM_SYMBOLS),
+                                  pcm((rate * bytes * STREAM_AHEAD_MS) / 1000);
+           vector<unsigned char>  chunk(std::max((rate * bytes * STREAM_WRITE_MS) / 1000, bytes) * 2);
+
+           std::thread            reader,
+                                  renderer;
+           try{
+               reader  =  std::thread([&](void){
+                   vector<unsigned char>  buff(1024);
+                   while(!abort){
+                       pollfd    pfd  { fd, POLLIN, 0 };
+                       const int ready { poll(&pfd, 1, STREAM_POLL_MS) };
+                       if(ready == 0 || (ready < 0 && errno == EINTR))
+                           continue;
+
+                       const ssize_t  res { ready < 0 ? -1 : read(fd, buff.data(), buff.size()) };
+                       const int      err { errno };
+                       if(log != nullptr){
+                           const std::lock_guard<std::mutex>  guard(logLock);
+                           *log << "Read len: " << res << endl;
+                       }
+                       if(res < 0 && (err == EINTR || err == EAGAIN))
+                           continue;
+                       if(res < 0)
+                           readErr  =  string("Dtmf::playStream : read failed: ").append(strerror(err));
+                       if(res <= 0)
+                           break;
+
+                       for(size_t done{ 0 }, num{ 0 }; done < static_cast<size_t>(res) && !abort; done += num){
+                           unsigned  spins { 0 };
+                           while((num = symbols.write(buff.data() + done, res - done)) == 0 && !abort)
+                               backoff(spins);
+                       }
+                   }
+                   readDone  =  true;
+               });
+
+               renderer  =  std::thread([&](void){
+                   auto  push { [&](const unsigned char* data, size_t len){
+                                    unsigned  spins { 0 };
+                                    for(size_t done{ 0 }; done < len && !abort; ){
+                                        const size_t  num { pcm.write(data + done, len - done) };
+                                        if(num == 0)
+                                            backoff(spins);
+                                        done += num;
+                                    }
+                                } };
+                   const ToneSlot&  gap   { bank->gap() };
+                   unsigned char    syms[64];
+                   unsigned         spins { 0 };
+
+                   while(!abort){
+                       const size_t  num { symbols.read(syms, sizeof(syms)) };
+                       if(num == 0){
+                           if(readDone && symbols.readable() == 0)
+                               break;
+                           backoff(spins);
+                           continue;
+                       }
+                       spins  =  0;
+
+                       for(size_t idx{ 0 }; idx < num; ++idx){
+                           const ToneSlot&  sl { bank->slot(static_cast<char>(syms[idx])) };
+                           if(sl.offset == ToneBank::NO_TONE){
+                               if(syms[idx] != '\n' && syms[idx] != '\r' && syms[idx] != '\t')
+                                   ++symbolsSkipped;
+                               continue;
+                           }
+                           push(bank->data(sl), sl.length);
+                           if(whiteSound)
+                               push(bank->data(gap), gap.length);
+                           ++rendered;
+                       }
+                   }
+                   renderDone  =  true;
+               });
+           }catch(...){
+               writeErr  =  "Dtmf::playStream : can't start the threads.";
+               abort     =  true;
+           }
+
+           // Writer: whole frames only, a partial one waits for its remaining bytes.
+           size_t                 pending { 0 };
+           unsigned               spins   { 0 };
+           while(!abort){
+               const size_t  num   { pcm.read(chunk.data() + pending, chunk.size() - pending) },
+                             total { pending + num },
+                             whole { total - total % bytes };
+               if(whole == 0){
+                   if(renderDone && pcm.readable() == 0)
+                       break;
+                   pending  =  total;
+                   backoff(spins);
+                   continue;
+               }
+               spins  =  0;
+
+               if(!sink->play(chunk.data(), whole, writeErr)){
+                   abort  =  true;
+                   break;
+               }
+               pending  =  total - whole;
+               memmove(chunk.data(), chunk.data() + whole, pending);
+           }
+
+           if(reader.joinable())     reader.join();
+           if(renderer.joinable())   renderer.join();
+           played(rendered, start);
+       }catch(...){
+           writeErr  =  "Dtmf::playStream : Unexpected Error.";
+       }
+
+       for(const string* err : { &writeErr, &readErr }){
+           if(!err->empty()){
+               errMsg  =  *err;
+               return false;
+           }
+       }
+
+       return true;
+    }
+
+} // End Namespace
@@ -0,0 +1,280 @@
+// -----------------------------------------------------------------
+// dtmftest - tests of dtmflib, run by "make check"
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace dtmfutil;
+
+namespace {
+
+    const string  ALL_SYMBOLS { "0123456789ABCD#*" };
+    size_t        failures    { 0 };
+
+    void check(bool cond, const string& name, const string& detail){
+        cout << (cond ? "PASS: " : "FAIL: ") << name;
+        if(!cond)
+            cout << " (" << detail << ")";
+        cout << endl;
+        if(!cond)
+            ++failures;
+    }
+
+    vector<float> render(const string& symbols, const DtmfTiming& tm, size_t rate){
+        const auto  sink { make_shared<MemorySink>(FORMAT_FLOAT) };
+        Dtmf        dtmf(sink, tm, rate);
+        if(!dtmf.init() || !dtmf.play(symbols))
+            throw string("render: ").append(dtmf.getErrMsg());
+
+        vector<float>  pcm(sink->getData().size() / sizeof(float));
+        memcpy(pcm.data(), sink->getData().data(), pcm.size() * sizeof(float));
+        return pcm;
+    }
+
+    // A recording played off speed: decoding it as if it were sampled at
+    // rate * speed scales every frequency by speed, as a wrong WAV rate does.
+    void testOffNominal(void){
+        for(const size_t rate : { 8000, 44100 }){
+            for(const DtmfTiming& tm : { TIMING_CLASSIC, TIMING_ITU_Q24 }){
+                const vector<float>  pcm { render(ALL_SYMBOLS + ALL_SYMBOLS, tm, rate) };
+                for(const double speed : { 0.985, 0.99, 1.0, 1.01, 1.015 }){
+                    DtmfDecoder  dec(static_cast<size_t>(lround(rate * speed)));
+                    dec.feed(pcm.data(), pcm.size());
+                    check(dec.getSymbols() == ALL_SYMBOLS + ALL_SYMBOLS,
+                          "off nominal " + to_string(rate) + " Hz, " + to_string(tm.toneMs) +
+                          " ms tones, speed " + to_string(speed), dec.getSymbols());
+                }
+            }
+        }
+    }
+
+    string decode(const vector<pair<string, DtmfTiming>>& parts, bool recovery){
+        vector<float>  pcm;
+        for(const auto& part : parts){
+            const vector<float>  chunk { render(part.first, part.second, 8000) };
+            pcm.insert(pcm.end(), chunk.begin(), chunk.end());
+        }
+
+        DtmfDecoder  dec(8000);
+        dec.setClockRecovery(recovery);
+        dec.feed(pcm.data(), pcm.size());
+        dec.flush();
+        return dec.getSymbols();
+    }
+
+    // A longer tone is one symbol, unless the gaps are too short to be seen
+    // and it lasts a whole number of tones; clock recovery is needed for that.
+    void testClockRecovery(void){
+        const string      lead    { ALL_SYMBOLS + ALL_SYMBOLS };
+        const DtmfTiming  gapless { 100, 0, 0 };
+        for(const bool recovery : { false, true }){
+            const string  mode { recovery ? " with recovery" : " without recovery" };
+            const string  spaced { decode({ { lead, TIMING_ITU_Q24 }, { "7", { 200, 40, 40 } },
+                                            { "0", { 120, 40, 40 } }, { "123", TIMING_ITU_Q24 } }, recovery) };
+            check(spaced == lead + "70123", "long tones" + mode, spaced);
+            const string  single { decode({ { lead, gapless }, { "9", { 150, 0, 0 } }, { "123", gapless } },
+                                          recovery) };
+            check(single == lead + "9123", "gapless long tone" + mode, single);
+        }
+        const string  merged { decode({ { lead, gapless }, { "55", gapless }, { "4441", gapless } }, true) };
+        check(merged == lead + "554441", "gapless repeats with recovery", merged);
+        // The last tone ends with the stream.
+        const string  trailing { decode({ { lead, gapless }, { "1555", gapless } }, true) };
+        check(trailing == lead + "1555", "trailing gapless repeats with recovery", trailing);
+    }
+
+    // Interleaved stereo: the tones on channel 1, channel 2 doesn't exist.
+    void testChannels(void){
+        const vector<float>  mono { render("123", TIMING_FAST, 8000) };
+        vector<float>        stereo(mono.size() * 2, 0.0F);
+        for(size_t idx{ 0 }; idx < mono.size(); ++idx)
+            stereo[idx * 2 + 1]  =  mono[idx];
+        const auto* const    pcm { reinterpret_cast<const unsigned char*>(stereo.data()) };
+
+        DtmfDecoder  dec(8000);
+        dec.feed(pcm, mono.size(), FORMAT_FLOAT, 2, 1);
+        check(dec.getSymbols() == "123", "channel 1 of 2", dec.getSymbols());
+
+        DtmfDecoder  bad(8000);
+        bad.feed(pcm, mono.size(), FORMAT_FLOAT, 2, 2);
+        check(bad.getSymbols().empty() && !bad.getErrMsg().empty(), "channel 2 of 2", bad.getErrMsg());
+    }
+
+    // Deterministic bytes, nothing for the compressor to find.
+    vector<unsigned char> noise(size_t len){
+        vector<unsigned char>  out(len);
+        uint32_t               state { 2463534242U };
+        for(auto& byte : out){
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            byte   = static_cast<unsigned char>(state);
+        }
+        return out;
+    }
+
+    string readFile(const string& name){
+        ifstream  in(name, ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    void writeFile(const string& name, const string& data){
+        ofstream  out(name, ios::binary | ios::trunc);
+        out << data;
+    }
+
+    // Wrong bytes spread over the frame, both nibbles of each replaced.
+    void damage(char* frame, size_t wrong){
+        for(size_t err{ 0 }; err < wrong; ++err){
+            const size_t  byte { err * (FecFrame::BYTES / wrong) };
+            frame[byte * 2]      =  frame[byte * 2]     == '0' ? '1' : '0';
+            frame[byte * 2 + 1]  =  frame[byte * 2 + 1] == '0' ? '1' : '0';
+        }
+    }
+
+    void testFecFrame(void){
+        FecFrame  frame { 7, FecFrame::DATA, false, {} };
+        const vector<unsigned char>  data { noise(FecFrame::DATA) };
+        memcpy(frame.data, data.data(), data.size());
+        char      symbols[FecFrame::SYMBOLS];
+        frame.encode(symbols);
+
+        for(const size_t wrong : { 0, 8, 9 }){
+            char  damaged[FecFrame::SYMBOLS];
+            memcpy(damaged, symbols, sizeof(damaged));
+            damage(damaged, wrong);
+
+            FecFrame  out     {};
+            size_t    fixed   { 0 };
+            const bool  ok    { FecFrame::decode(damaged, out, fixed) };
+            if(wrong <= FecFrame::PARITY / 2)
+                check(ok && fixed == wrong && out.seq == 7 && memcmp(out.data, data.data(), data.size()) == 0,
+                      "fec frame with " + to_string(wrong) + " wrong bytes", "corrected " + to_string(fixed));
+            else
+                check(!ok, "fec frame with " + to_string(wrong) + " wrong bytes", "decoded");
+        }
+    }
+
+    // A whole file through -b -F and -t -F: wrong bytes in every frame, a
+    // symbol added or dropped, and a frame past repair.
+    void testFecStream(void){
+        const string  plain   { "dtmftest.fec.bin" },
+                      tones   { "dtmftest.fec.tones" },
+                      decoded { "dtmftest.fec.out" };
+        const vector<unsigned char>  data { noise(FecFrame::DATA * 5 + 17) };
+        writeFile(plain, string(data.begin(), data.end()));
+
+        const BinFileToDtmf  enc(plain, FRAMING_FEC);
+        if(!enc.saveTo(tones))
+            throw string("testFecStream: can't encode.");
+        const string  clean { readFile(tones) };
+
+        const size_t  frames   { clean.size() / FecFrame::SYMBOLS };
+        string        wrong    { clean },
+                      inserted { clean },
+                      dropped  { clean },
+                      lost     { clean };
+        for(size_t idx{ 0 }; idx < frames; ++idx)
+            damage(&wrong[idx * FecFrame::SYMBOLS], FecFrame::PARITY / 2);
+        inserted.insert(FecFrame::SYMBOLS + 40, 1, '5');
+        dropped.erase(FecFrame::SYMBOLS * 3 + 70, 1);
+        damage(&lost[FecFrame::SYMBOLS * 2], FecFrame::PARITY / 2 + 1);
+
+        for(const auto& test : { make_pair(string("clean"), clean), make_pair(string("8 wrong bytes a frame"), wrong),
+                                 make_pair(string("symbol added"), inserted),
+                                 make_pair(string("symbol dropped"), dropped) }){
+            writeFile(tones, test.second);
+            const DtmfToBinFile  dec(tones, DECODE_STRICT, FRAMING_FEC);
+            const bool           ok  { dec.saveTo(decoded) };
+            check(ok && readFile(decoded) == string(data.begin(), data.end()),
+                  "fec stream, " + test.first, dec.getResult().errMsg);
+            if(test.second == wrong)
+                check(dec.getResult().corrected == frames * FecFrame::PARITY / 2, "fec stream, bytes corrected",
+                      to_string(dec.getResult().corrected));
+        }
+
+        writeFile(tones, lost);
+        const DtmfToBinFile  dec(tones, DECODE_STRICT, FRAMING_FEC);
+        check(!dec.saveTo(decoded) && dec.getResult().errMsg.find("Uncorrectable") != string::npos,
+              "fec stream, 9 wrong bytes", dec.getResult().errMsg);
+
+        unlink(plain.c_str());
+        unlink(tones.c_str());
+        unlink(decoded.c_str());
+    }
+
+    void testPacker(void){
+        vector<unsigned char>  repeated;
+        for(size_t idx{ 0 }; idx < 1U << 20; ++idx)
+            repeated.push_back(static_cast<unsigned char>("0123456789ABCD#*"[idx % 16]));
+
+        for(const auto& test : { make_pair(string("empty"), vector<unsigned char>()),
+                                 make_pair(string("incompressible"), noise(100000)),
+                                 make_pair(string("repetitive"), repeated) }){
+            vector<unsigned char>  packed,
+                                   plain;
+            Packer::pack(test.second.data(), test.second.size(), packed);
+            // Data which doesn't compress is stored: never more than the header is added.
+            check(Packer::unpack(packed.data(), packed.size(), plain) && plain == test.second &&
+                  packed.size() <= test.second.size() + Packer::HEADER,
+                  "packer " + test.first, to_string(packed.size()) + " bytes packed");
+        }
+
+        vector<unsigned char>  small;
+        Packer::pack(repeated.data(), repeated.size(), small);
+        check(small.size() < repeated.size() / 100, "packer repetitive ratio", to_string(small.size()) + " bytes packed");
+
+        vector<unsigned char>  packed,
+                               plain;
+        const vector<unsigned char>  text { repeated.begin(), repeated.begin() + 5000 };
+        Packer::pack(text.data(), text.size(), packed);
+
+        vector<unsigned char>  truncated { packed.begin(), packed.end() - 4 };
+        check(!Packer::unpack(truncated.data(), truncated.size(), plain), "packer truncated", "unpacked");
+        vector<unsigned char>  corrupted { packed };
+        corrupted[corrupted.size() / 2] ^= 0x20;
+        check(!Packer::unpack(corrupted.data(), corrupted.size(), plain), "packer corrupted", "unpacked");
+        vector<unsigned char>  oversized { packed };
+        oversized[4] = oversized[5] = oversized[6] = oversized[7] = 0xFF;
+        check(!Packer::unpack(oversized.data(), oversized.size(), plain), "packer oversized header", "unpacked");
+    }
+
+} // End Anonymous Namespace
+
+int main(void){
+    try{
+        testOffNominal();
+        testClockRecovery();
+        testChannels();
+        testFecFrame();
+        testFecStream();
+        testPacker();
+    }catch(string& err){
+        cerr << "Error: " << err << endl;
+        return 1;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+// -----------------------------------------------------------------
+// dtmflib - a library to generate DTMF tones, encode/decode data.
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include <dtmf.hpp>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+
+namespace dtmfutil {
+
+    using std::string;
+    using std::vector;
+
+    namespace {
+
+        constexpr size_t  PAD_MS        { 50  };    // Silence around every test payload
+        constexpr size_t  SEARCH_GAP_MS { 100 };    // Gap used while the tone is searched
+
+        string testPayload(size_t seed){
+            std::minstd_rand  gen(static_cast<std::minstd_rand::result_type>(seed + 1));
+            string            out(AutoTuner::TEST_SYMBOLS, '0');
+
+            for(char& sym : out)
+                sym  =  dtmfDigits[gen() & 0x0F];
+
+            return out;
+        }
+
+        void toFloat(const RawSoundArray& pcm, SampleFormat fmt, size_t lead, size_t trail, vector<float>& out){
+            const size_t  len { pcm.size() / sampleBytes(fmt) };
+
+            out.assign(lead + len + trail, 0.0F);
+            for(size_t idx{ 0 }; idx < len; ++idx){
+                float&  val { out[lead + idx] };
+                switch(fmt){
+                    case FORMAT_U8:
+                        val  =  (static_cast<float>(pcm[idx]) - 128.0F) * (1.0F / 128.0F);
+                    break;
+                    case FORMAT_S16_LE:
+                        val  =  static_cast<int16_t>(pcm[idx * 2] | pcm[idx * 2 + 1] << 8) * (1.0F / 32768.0F);
+                    break;
+                    case FORMAT_FLOAT:
+                        memcpy(&val, &pcm[idx * 4], sizeof(val));
+                    break;
+                }
+            }
+        }
+
+        size_t distance(const string& sent, const string& got){
+            vector<size_t>  row(got.size() + 1);
+
+            for(size_t col{ 0 }; col <= got.size(); ++col)
+                row[col]  =  col;
+            for(size_t pos{ 1 }; pos <= sent.size(); ++pos){
+                size_t  diag { row[0] };
+                row[0]  =  pos;
+                for(size_t col{ 1 }; col <= got.size(); ++col){
+                    const size_t  up { row[col] };
+                    row[col]  =  std::min({ row[col] + 1, row[col - 1] + 1,
+                                            diag + (sent[pos - 1] == got[col - 1] ? 0 : 1) });
+                    diag      =  up;
+                }
+            }
+
+            return row[got.size()];
+        }
+
+        float parseFloat(const string& tok, const string& name){
+            char*        end { nullptr };
+            const float  val { strtof(tok.c_str(), &end) };
+
+            if(tok.empty() || *end != '\0' || !std::isfinite(val))
+                throw string("LinkModel::fromName : invalid link model: ").append(name);
+
+            return val;
+        }
+
+    } // End Anonymous Namespace
+
+    LinkModel LinkModel::fromName(const string& name){
+        if(name == "clean")
+            return LINK_CLEAN;
+
+        // noise[:cutoff[:drift]]
+        LinkModel           link    { LINK_CLEAN };
+        size_t              fields  { 0 };
+        std::istringstream  spec(name);
+        for(string tok; std::getline(spec, tok, ':'); ++fields){
+            switch(fields){
+                case 0:
+                    link.noise   =  parseFloat(tok, name);
+                break;
+                case 1:
+                    if(tok.empty() || tok.size() > 6 || tok.find_first_not_of("0123456789") != string::npos)
+                        throw string("LinkModel::fromName : invalid link model: ").append(name);
+                    link.cutoff  =  std::stoul(tok);
+                break;
+                case 2:
+                    link.drift   =  parseFloat(tok, name);
+                break;
+                default:
+                    throw string("LinkModel::fromName : invalid link model: ").append(name);
+            }
+        }
+
+        if(fields == 0 || link.noise < 0.0F || link.noise > 1.0F || std::fabs(link.drift) >= 0.5F)
+            throw string("LinkModel::fromName : invalid link model: ").append(name);
+
+        return link;
+    }
+
+    constexpr size_t  AutoTuner::MAX_MS;
+
+    AutoTuner::AutoTuner(const LinkModel& lnk, size_t sSize, SampleFormat fmt, size_t trl)
+       : link(lnk),
+         sampleSize{ sSize },
+         trials{ std::max<size_t>(trl, 1) },
+         format{ fmt },
+         minimum(TIMING_CLASSIC),
+         profile(TIMING_CLASSIC),
+         errMsg{ "No error" }
+    {
+        if(sampleSize == 0)
+            throw string("AutoTuner::AutoTuner : invalid sample rate.");
+    }
+
+    void AutoTuner::degrade(vector<float>& pcm, size_t seed) const{
+        // Speed drift: the recording is resampled, tones get shorter or longer.
+        if(link.drift != 0.0F && pcm.size() > 1){
+            const double   step { 1.0 + link.drift };
+            vector<float>  out(static_cast<size_t>((pcm.size() - 1) / step));
+            for(size_t idx{ 0 }; idx < out.size(); ++idx){
+                const double  pos  { idx * step };
+                const size_t  base { static_cast<size_t>(pos) };
+                const float   frac { static_cast<float>(pos - base) };
+                out[idx]  =  pcm[base] + (pcm[base + 1] - pcm[base]) * frac;
+            }
+            pcm.swap(out);
+        }
+
+        // Band limit: two one-pole low-pass stages.
+        if(link.cutoff != 0 && link.cutoff < sampleSize / 2){
+            const float  alpha { 1.0F - expf(-2.0F * static_cast<float>(M_PI) * link.cutoff / sampleSize) };
+            float        st1   { 0.0F },
+                         st2   { 0.0F };
+            for(float& val : pcm){
+                st1  +=  alpha * (val - st1);
+                st2  +=  alpha * (st1 - st2);
+                val   =  st2;
+            }
+        }
+
+        if(link.noise > 0.0F){
+            std::mt19937                     gen(static_cast<std::mt19937::result_type>(seed + 1));
+            std::normal_distribution<float>  dist(0.0F, link.noise);
+            for(float& val : pcm)
+                val  +=  dist(gen);
+        }
+    }
+
+    size_t AutoTuner::errors(const DtmfTiming& tm) const{
+        Dtmf           dtmf(std::make_shared<MemorySink>(format), tm, sampleSize, true);
+        DtmfDecoder    dec(sampleSize);
+        RawSoundArray  pcm;
+        vector<float>  wave;
+        size_t         total { 0 };
+        const size_t   pad   { (PAD_MS * sampleSize) / 1000 },
+                       block { std::max<size_t>(sampleSize / 100, 1) };      // Decoder default, 10 ms
+
+        if(!dtmf.init())
+            throw string("AutoTuner::errors : ").append(dtmf.getErrMsg());
+        for(size_t trial{ 0 }; trial < trials; ++trial){
+            const string  sent { testPayload(trial) };
+            if(!dtmf.render(sent.data(), sent.size(), pcm))
+                throw string("AutoTuner::errors : ").append(dtmf.getErrMsg());
+
+            // Trials start at different offsets from the decoder blocks.
+            toFloat(pcm, format, pad + (trial * block) / trials, pad, wave);
+            degrade(wave, trial);
+            dec.reset();
+            dec.feed(wave.data(), wave.size());
+            total  +=  distance(sent, dec.getSymbols());
+        }
+
+        return total;
+    }
+
+    bool AutoTuner::tune(size_t margin) noexcept{
+        try{
+            // Shortest duration, in ms, decoded without errors. It's a scan, not a
+            // bisection: with noise, long tones can fail where shorter ones don't,
+            // the decoder has more time to lose and find them again.
+            auto  shortest { [&](auto make){
+                for(size_t ms{ MIN_MS }; ms <= MAX_MS; ++ms)
+                    if(errors(make(ms)) == 0)
+                        return ms;
+                return static_cast<size_t>(0);
+            } };
+
+            const size_t  tone { shortest([](size_t ms){ return DtmfTiming{ ms, SEARCH_GAP_MS, SEARCH_GAP_MS }; }) };
+            if(tone == 0){
+                errMsg  =  string("AutoTuner::tune : no error free profile up to ")
+                           .append(std::to_string(MAX_MS)).append(" ms tones.");
+                return false;
+            }
+            // The gap is searched with the recommended tone: at the shortest one
+            // detection is marginal whatever the gap.
+            auto          widen   { [margin](size_t ms){ return ms + (ms * margin + 99) / 100; } };
+            const size_t  toneRec { widen(tone) },
+                          gap     { shortest([toneRec](size_t ms){ return DtmfTiming{ toneRec, ms, ms }; }) };
+            if(gap == 0){
+                errMsg  =  string("AutoTuner::tune : no error free profile up to ")
+                           .append(std::to_string(MAX_MS)).append(" ms gaps.");
+                return false;
+            }
+
+            DtmfTiming    rec     { toneRec, widen(gap), widen(gap) };
+            while(errors(rec) != 0){
+                if(rec.toneMs >= MAX_MS){
+                    errMsg  =  "AutoTuner::tune : no error free profile with the margin.";
+                    return false;
+                }
+                rec.toneMs  =  std::min(rec.toneMs + MIN_MS, MAX_MS);
+                rec.gapMs   =  rec.pauseMs  =  rec.gapMs + MIN_MS;
+            }
+
+            minimum  =  DtmfTiming{ tone, gap, gap };
+            profile  =  rec;
+        }catch(string& err){
+            errMsg  =  err;
+            return false;
+        }catch(...){
+            errMsg  =  "AutoTuner::tune : Unexpected Error.";
+            return false;
+        }
+
+        return true;
+    }
+
+    const DtmfTiming& AutoTuner::getProfile(void) const noexcept{
+          return profile;
+    }
+
+    const DtmfTiming& AutoTuner::getMinimum(void) const noexcept{
+          return minimum;
+    }
+
+    const string& AutoTuner::getErrMsg(void) const noexcept{
+          return errMsg;
+    }
+
+} // End Namespace
@@ -20,12 +20,27 @@
 #include <parseCmdLine.hpp>
 #include <config.h>
 
+#include <sstream>
+#include <cmath>
+#include <csignal>
+#include <sys/stat.h>
+
 using namespace std;
 using namespace dtmfutil;
 using namespace parcmdline;
 
 void paramError(const char* progname, const char* err)  noexcept    __attribute__ ((noreturn));
 void versionInfo(void)                                  noexcept    __attribute__ ((noreturn));
+int  playStdin(const Dtmf& dtmf, bool verbose)          noexcept;
+int  splitLanes(const string& inFile, const string& outFile, size_t lanes, bool compress);
+int  joinLanes(const string& inFile, const string& outFile, size_t lanes);
+int  receiveTones(const string& source, const string& outFile, size_t rate, SampleFormat format, bool verbose);
+void stopListening(int sig)                             noexcept;
+void printClock(const DtmfDecoder& dec, const string& prefix);
+
+namespace {
+    DtmfReceiver* volatile  receiver { nullptr };
+}
 
 int main(int argc, char **argv) {
 
@@ -34,7 +49,7 @@ int main(int argc, char **argv) {
    try{
 
        if(argc != 1){
-           constexpr char    flags[]    { "c:b:t:o:s:hV" };
+           constexpr char    flags[]    { "c:m:b:t:d:o:s:w:p:f:r:i:j:n:x:e:a:k:l:FzSRvhV" };
            ParseCmdLine      pcl(argc, argv, flags);
            if(pcl.getErrorState()){
                string exitMsg{string("Invalid  parameter or value").append(pcl.getErrorMsg())};
@@ -46,36 +61,223 @@ int main(int argc, char **argv) {
     
             if( !pcl.isSet('b')  &&
                 !pcl.isSet('c')  &&
+                !pcl.isSet('m')  &&
                 !pcl.isSet('t')  &&
+                !pcl.isSet('d')  &&
                 !pcl.isSet('o')  &&
                 !pcl.isSet('s')  &&
+                !pcl.isSet('w')  &&
+                !pcl.isSet('p')  &&
+                !pcl.isSet('f')  &&
+                !pcl.isSet('r')  &&
+                !pcl.isSet('i')  &&
+                !pcl.isSet('j')  &&
+                !pcl.isSet('n')  &&
+                !pcl.isSet('x')  &&
+                !pcl.isSet('e')  &&
+                !pcl.isSet('a')  &&
+                !pcl.isSet('F')  &&
+                !pcl.isSet('z')  &&
+                !pcl.isSet('k')  &&
+                !pcl.isSet('S')  &&
+                !pcl.isSet('R')  &&
+                !pcl.isSet('l')  &&
+                !pcl.isSet('v')  &&
                 !pcl.isSet('h')  &&
                 !pcl.isSet('V')) 
                      paramError(argv[0], "Invalid Parameter(s).");
     
            if( (pcl.isSet('s') && pcl.isSet('b')) ||
                (pcl.isSet('s') && pcl.isSet('c')) ||
+               (pcl.isSet('s') && pcl.isSet('m')) ||
                (pcl.isSet('s') && pcl.isSet('t')) ||
+               (pcl.isSet('s') && pcl.isSet('d')) ||
                (pcl.isSet('s') && pcl.isSet('o')) )
-                     paramError(argv[0], "-s isn't compatible with these options: -b, -c, -t, -o.");
+                     paramError(argv[0], "-s isn't compatible with these options: -b, -c, -m, -t, -d, -o.");
+
+           if( pcl.isSet('x') &&
+               (pcl.isSet('s') || pcl.isSet('b') || pcl.isSet('c') || pcl.isSet('m') ||
+                pcl.isSet('t') || pcl.isSet('d') || pcl.isSet('o') || pcl.isSet('v')) )
+                     paramError(argv[0], "-x isn't compatible with these options: -s, -b, -c, -m, -t, -d, -o, -v.");
 
            if( (pcl.isSet('b') && !pcl.isSet('o')) ||
                (pcl.isSet('c') && !pcl.isSet('o')) ||
+               (pcl.isSet('m') && !pcl.isSet('o')) ||
                (pcl.isSet('t') && !pcl.isSet('o')) ||
-               (pcl.isSet('o') && !( pcl.isSet('b') ||  pcl.isSet('c') || pcl.isSet('t'))))
-                     paramError(argv[0], "-b, -c or -t requires -o and vice versa.");
+               (pcl.isSet('d') && !pcl.isSet('o')) ||
+               (pcl.isSet('l') && !pcl.isSet('o')) ||
+               (pcl.isSet('o') && !( pcl.isSet('b') ||  pcl.isSet('c') || pcl.isSet('m') ||
+                                     pcl.isSet('t') ||  pcl.isSet('d') || pcl.isSet('l'))))
+                     paramError(argv[0], "-b, -c, -m, -t, -d or -l requires -o and vice versa.");
+
+           if( pcl.isSet('l') &&
+               (pcl.isSet('s') || pcl.isSet('b') || pcl.isSet('c') || pcl.isSet('m') || pcl.isSet('t') ||
+                pcl.isSet('d') || pcl.isSet('w') || pcl.isSet('p') || pcl.isSet('x') || pcl.isSet('a') ||
+                pcl.isSet('n') || pcl.isSet('k') || pcl.isSet('S')) )
+                     paramError(argv[0], "-l is only compatible with -o, -f, -r and -v.");
+
+           if(pcl.isSet('i') && !(pcl.isSet('t') || pcl.isSet('m')))
+                     paramError(argv[0], "-i requires -t or -m.");
+
+           if(pcl.isSet('j') && !(pcl.isSet('b') || pcl.isSet('t') || pcl.isSet('d')))
+                     paramError(argv[0], "-j requires -b, -t or -d.");
+
+           if( pcl.isSet('a') &&
+               (pcl.isSet('s') || pcl.isSet('b') || pcl.isSet('c') || pcl.isSet('m') || pcl.isSet('t') ||
+                pcl.isSet('d') || pcl.isSet('o') || pcl.isSet('w') || pcl.isSet('p') || pcl.isSet('v') ||
+                pcl.isSet('x') || pcl.isSet('n')) )
+                     paramError(argv[0], "-a is only compatible with -f and -r.");
+
+           if(pcl.isSet('n') && !(pcl.isSet('b') || pcl.isSet('t') || pcl.isSet('d') || pcl.isSet('x')))
+                     paramError(argv[0], "-n requires -b, -t, -d or -x.");
+
+           if(pcl.isSet('n') && (pcl.isSet('i') || (pcl.isSet('j') && !pcl.isSet('d'))))
+                     paramError(argv[0], "-n isn't compatible with -i, nor with -j unless with -d.");
+
+           if(pcl.isSet('F') && (!(pcl.isSet('b') || pcl.isSet('t')) || pcl.isSet('n')))
+                     paramError(argv[0], "-F requires -b or -t and isn't compatible with -n.");
+
+           if(pcl.isSet('z') && !(pcl.isSet('b') || pcl.isSet('x')))
+                     paramError(argv[0], "-z requires -b or -x.");
+
+           if(pcl.isSet('e') && (!pcl.isSet('x') || pcl.isSet('w')))
+                     paramError(argv[0], "-e requires -x and isn't compatible with -w.");
+
+           if(pcl.isSet('R') && !pcl.isSet('d'))
+                     paramError(argv[0], "-R requires -d.");
+
+           size_t      lanes { 1 };
+           if(pcl.isSet('n')){
+               const string& val { pcl.getValue('n') };
+               lanes  =  (!val.empty() && val.size() < 4 && val.find_first_not_of("0123456789") == string::npos)
+                         ? stoul(val) : 0;
+               if(lanes == 0 || lanes > LaneHeader::MAX_LANES)
+                   paramError(argv[0], "-n requires a number of lanes from 1 to 255.");
+           }
+
+           size_t      threads { 1 };
+           if(pcl.isSet('j')){
+               const string& val { pcl.getValue('j') };
+               if(val.empty() || val.size() > 4 || val.find_first_not_of("0123456789") != string::npos)
+                   paramError(argv[0], "-j requires a number of threads, 0 for all the cores.");
+               threads  =  stoul(val);
+           }
+
+           DecodeMode  mode { DECODE_STRICT };
+           if(pcl.isSet('i')){
+               if(pcl.getValue('i') == "space")
+                   mode  =  DECODE_SKIP_SPACE;
+               else if(pcl.getValue('i') == "invalid")
+                   mode  =  DECODE_SKIP_INVALID;
+               else
+                   paramError(argv[0], "-i requires 'space' or 'invalid'.");
+           }
+
+           const Framing  framing { pcl.isSet('F') ? FRAMING_FEC : FRAMING_NONE };
+
+           const bool  playOpts { !pcl.isSet('l') &&
+                                  (pcl.isSet('w') || pcl.isSet('p') || pcl.isSet('f') || pcl.isSet('r') ||
+                                   (pcl.isSet('v') && !pcl.isSet('d')) || pcl.isSet('k') || pcl.isSet('S')) };
+           if( playOpts && 
+               (pcl.isSet('b') || pcl.isSet('c') || pcl.isSet('m') || pcl.isSet('t') || pcl.isSet('d') || pcl.isSet('o')) )
+                     paramError(argv[0], "-w, -p, -f, -r, -v, -k and -S are only compatible with -s.");
+
+           if((pcl.isSet('k') || pcl.isSet('S')) && (pcl.isSet('x') || pcl.isSet('a')))
+                     paramError(argv[0], "-k and -S aren't compatible with -x and -a.");
+
+           const DtmfTiming       timing { pcl.isSet('p') ? DtmfTiming::fromName(pcl.getValue('p'))
+                                                          : TIMING_CLASSIC };
+           const SampleFormat     format { pcl.isSet('f') ? formatFromName(pcl.getValue('f'))
+                                                          : FORMAT_U8 };
+           size_t                 rate   { 8000 };
+           if(pcl.isSet('r')){
+               const string& val { pcl.getValue('r') };
+               if(val == "native")
+                   rate  =  AlsaPlay::nativeRate();
+               else
+                   rate  =  (!val.empty() && val.size() < 7 && val.find_first_not_of("0123456789") == string::npos)
+                            ? stoul(val) : 0;
+               if(rate < 4000)
+                   paramError(argv[0], "-r requires a sample rate of at least 4000 Hz or 'native'.");
+           }
+
+           if(pcl.isSet('a')){
+               AutoTuner  tuner(LinkModel::fromName(pcl.getValue('a')), rate, format);
+               if(tuner.tune()){
+                  const DtmfTiming&  tm { tuner.getProfile() };
+                  cerr << "Shortest error free tone: " << tuner.getMinimum().toneMs
+                       << " ms, gap: " << tuner.getMinimum().gapMs << " ms." << endl;
+                  cout << tm.toneMs << ':' << tm.gapMs << ':' << tm.pauseMs << endl;
+               }else{
+                  cerr << "Tuner error: " << tuner.getErrMsg() << endl;
+                  ret  =  1;
+               }
+           }
+
+           if(pcl.isSet('x')){
+               vector<shared_ptr<AudioSink>>  sinks;
+               if(pcl.isSet('w')){
+                   sinks.push_back(make_shared<WavFileSink>(pcl.getValue('w'), rate, format, lanes));
+               }else{
+                   istringstream  devices(pcl.isSet('e') ? pcl.getValue('e') : "default");
+                   for(string dev; getline(devices, dev, ',');)
+                       if(!dev.empty())
+                           sinks.push_back(make_shared<AlsaPlay>(rate, dev, format, lanes));
+               }
+
+               LaneTransmitter  ltx(sinks, timing, rate);
+               bool             sent { false };
+               if(pcl.isSet('z')){
+                   ifstream  iFile(pcl.getValue('x'), ios::in | ios::binary);
+                   if(!iFile)
+                       throw string("can't open file: ").append(pcl.getValue('x'));
+                   vector<unsigned char>  packed;
+                   Packer::packStream(iFile, packed);
+                   sent  =  ltx.send(packed.data(), packed.size());
+               }else{
+                   sent  =  ltx.sendFile(pcl.getValue('x'));
+               }
+               if(!sent){
+                  cerr << "Transmitter error: " << ltx.getErrMsg() << endl;
+                  ret  =  1;
+               }
+           }
+
+           shared_ptr<AudioSink>  sink;
+           if(pcl.isSet('w') && !pcl.isSet('x'))
+               sink  =  make_shared<WavFileSink>(pcl.getValue('w'), rate, format);
+           else if((pcl.isSet('s') || playOpts) && !pcl.isSet('x') && !pcl.isSet('a'))
+               sink  =  make_shared<AlsaPlay>(rate, "default", format);
+
+           // A saved bank is mapped instead of synthesized.
+           shared_ptr<const ToneBank>  tones;
+           if(sink)
+               tones  =  pcl.isSet('k') ? ToneBank::cached(pcl.getValue('k'), rate, timing, timing.toneMs, format)
+                                        : make_shared<const ToneBank>(rate, timing, timing.toneMs, format);
+
+           if(playOpts && !pcl.isSet('s') && !pcl.isSet('x') && !pcl.isSet('a')){
+               Dtmf  dtmf(sink, tones);
+               ret  =  playStdin(dtmf, pcl.isSet('v'));
+               if(pcl.isSet('S'))
+                  cerr << "Playback statistics:\n" << dtmf.getStats();
+           }
     
            if(pcl.isSet('s')){
-               Dtmf  dtmf;
-               dtmf.init();
+               Dtmf  dtmf(sink, tones);
                bool res { dtmf.play(pcl.getValue('s')) };
-               if(!res) 
+               if(!res){
                   cerr << "Player error: " << dtmf.getErrMsg() << endl;
+                  ret  =  1;
+               }
+               if(pcl.isSet('S'))
+                  cerr << "Playback statistics:\n" << dtmf.getStats();
            }
     
-           if(pcl.isSet('b')){
-               BinFileToDtmf ftd(pcl.getValue('b'));
-               ftd.saveTo(pcl.getValue('o'));
+           if(pcl.isSet('b') && pcl.isSet('n')){
+               ret  =  splitLanes(pcl.getValue('b'), pcl.getValue('o'), lanes, pcl.isSet('z'));
+           }else if(pcl.isSet('b')){
+               BinFileToDtmf ftd(pcl.getValue('b'), framing, pcl.isSet('z'));
+               ftd.saveTo(pcl.getValue('o'), threads);
            }
     
            if(pcl.isSet('c')){
@@ -83,30 +285,60 @@ int main(int argc, char **argv) {
                etd.saveTo(pcl.getValue('o'));
            }
     
-           if(pcl.isSet('t')){
-               DtmfToBinFile dtf(pcl.getValue('t'));
-               dtf.saveTo(pcl.getValue('o'));
+           if(pcl.isSet('m')){
+               MT8870DtmfToBinFile mtd(pcl.getValue('m'), mode);
+               if(!mtd.saveTo(pcl.getValue('o'))){
+                  cerr << "Decoding error: " << mtd.getResult().errMsg << endl;
+                  ret  =  1;
+               }else if(mtd.getResult().skipped != 0){
+                  cerr << "Skipped frames: " << mtd.getResult().skipped << endl;
+               }
+           }
+
+           if(pcl.isSet('t') && pcl.isSet('n')){
+               ret  =  joinLanes(pcl.getValue('t'), pcl.getValue('o'), lanes);
+           }else if(pcl.isSet('t')){
+               DtmfToBinFile dtf(pcl.getValue('t'), mode, framing);
+               if(!dtf.saveTo(pcl.getValue('o'), threads)){
+                  cerr << "Decoding error: " << dtf.getResult().errMsg << endl;
+                  ret  =  1;
+               }else if(dtf.getResult().skipped != 0){
+                  cerr << "Skipped symbols: " << dtf.getResult().skipped << endl;
+               }
+               if(dtf.getResult().corrected != 0)
+                  cerr << "Corrected bytes: " << dtf.getResult().corrected << endl;
+           }
+
+           if(pcl.isSet('d') && pcl.isSet('n')){
+               DtmfDecoder dec;
+               dec.setClockRecovery(pcl.isSet('R'));
+               for(size_t lane{ 0 }; lane < lanes; ++lane){
+                   if(!dec.saveTo(pcl.getValue('d'), pcl.getValue('o') + "." + to_string(lane), lane, threads)){
+                      cerr << "Decoder error: " << dec.getErrMsg() << endl;
+                      ret  =  1;
+                      break;
+                   }
+                   if(pcl.isSet('v'))
+                      printClock(dec, "Lane " + to_string(lane) + ": ");
+               }
+           }else if(pcl.isSet('d')){
+               DtmfDecoder dec;
+               dec.setClockRecovery(pcl.isSet('R'));
+               if(!dec.saveTo(pcl.getValue('d'), pcl.getValue('o'), DtmfDecoder::MIX_CHANNELS, threads)){
+                  cerr << "Decoder error: " << dec.getErrMsg() << endl;
+                  ret  =  1;
+               }else if(pcl.isSet('v'))
+                  printClock(dec, "");
+           }else if(pcl.isSet('l')){
+               ret  =  receiveTones(pcl.getValue('l'), pcl.getValue('o'), rate,
+                              pcl.isSet('f') ? format : FORMAT_S16_LE, pcl.isSet('v'));
            }
     
        }else{
-           vector<char> buff(1024);
-           fill(buff.begin(), buff.end(), 0);
-    
            Dtmf  dtmf;
-           dtmf.init();
-    
-           while(true){
-                ssize_t  res   { read(STDIN_FILENO, buff.data(), buff.size()) };
-                cerr  << "Read len: " << res << endl;
-                if(res > 0){
-                    bool bres { dtmf.play(buff.data(), res) };
-                    if(!bres) 
-                        cerr << "Player error: " << dtmf.getErrMsg() << endl;
-                }else{
-                    ret = res < 0 ? 1 : 0;
-                    break;
-                }
-           }
+           if(!dtmf.init())
+               throw string(dtmf.getErrMsg());
+           ret  =  playStdin(dtmf, false);
        }
    }catch(string& err){
        cerr << "Error: " << err << endl;
@@ -120,6 +352,110 @@ int main(int argc, char **argv) {
    return ret;
 }
 
+int playStdin(const Dtmf& dtmf, bool verbose) noexcept{
+   const bool  res { dtmf.playStream(STDIN_FILENO, verbose ? &cerr : nullptr) };
+   if(!res)
+       cerr << "Player error: " << dtmf.getErrMsg() << endl;
+   if(dtmf.getSkipped() != 0)
+       cerr << "Skipped symbols: " << dtmf.getSkipped() << endl;
+
+   return res ? 0 : 1;
+}
+
+int splitLanes(const string& inFile, const string& outFile, size_t lanes, bool compress){
+   ifstream  iFile(inFile, ios::in | ios::binary);
+   if(!iFile)
+       throw string("can't open file: ").append(inFile);
+
+   vector<unsigned char>  data;
+   if(compress)
+       Packer::packStream(iFile, data);
+   else
+       data.assign(istreambuf_iterator<char>(iFile), istreambuf_iterator<char>());
+   const vector<string>   streams { LaneTransmitter::split(data.data(), data.size(), lanes) };
+
+   for(size_t lane{ 0 }; lane < lanes; ++lane){
+       const string  name { outFile + "." + to_string(lane) };
+       ofstream      oFile(name, ios::out | ios::binary | ios::trunc);
+       oFile << streams[lane];
+       oFile.close();
+       if(!oFile)
+           throw string("can't write file: ").append(name);
+   }
+
+   return 0;
+}
+
+int joinLanes(const string& inFile, const string& outFile, size_t lanes){
+   LaneReassembler  lrs;
+
+   for(size_t lane{ 0 }; lane < lanes; ++lane){
+       if(!lrs.addFile(inFile + "." + to_string(lane))){
+           cerr << "Decoding error: " << lrs.getErrMsg() << endl;
+           return 1;
+       }
+   }
+   if(!lrs.saveTo(outFile)){
+       cerr << "Decoding error: " << lrs.getErrMsg() << endl;
+       return 1;
+   }
+
+   return 0;
+}
+
+void stopListening(int sig) noexcept{
+   static_cast<void>(sig);
+   if(receiver != nullptr)
+       receiver->stop();
+}
+
+int receiveTones(const string& source, const string& outFile, size_t rate, SampleFormat format, bool verbose){
+   // A regular file is a recording, anything else an ALSA capture device.
+   struct stat              info;
+   shared_ptr<AudioSource>  src;
+   if(stat(source.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+       src  =  make_shared<WavFileSource>(source);
+   else
+       src  =  make_shared<AlsaCapture>(rate, source, format);
+
+   ofstream      oFile(outFile, ios::out | ios::binary | ios::trunc);
+   if(!oFile)
+       throw string("can't open file: ").append(outFile);
+
+   DtmfReceiver  rcv(src);
+   const size_t  srcRate { src->getSampleSize() };
+   if(verbose)
+       rcv.setCallback([srcRate](char sym, uint64_t sample){
+           cerr << "Symbol: " << sym << " at " << (sample * 1000) / srcRate << " ms" << endl;
+       });
+
+   receiver  =  &rcv;
+   signal(SIGINT,  stopListening);
+   signal(SIGTERM, stopListening);
+   const bool    res { rcv.run(oFile) };
+   signal(SIGINT,  SIG_DFL);
+   signal(SIGTERM, SIG_DFL);
+   receiver  =  nullptr;
+
+   cerr << "Received symbols: " << rcv.getSymbols() << ", bytes: " << rcv.getBytes() << endl;
+   if(rcv.hasPending())
+       cerr << "Warning: the last symbol has no pair, it was dropped." << endl;
+   if(!res){
+       cerr << "Receiver error: " << rcv.getErrMsg() << endl;
+       return 1;
+   }
+
+   return 0;
+}
+
+void printClock(const DtmfDecoder& dec, const string& prefix){
+   if(dec.getToneMs() == 0.0F)
+       cerr << prefix << "too few tones to measure them." << endl;
+   else
+       cerr << prefix << "tones of " << lroundf(dec.getToneMs()) << " ms, gaps of "
+            << lroundf(dec.getGapMs()) << " ms." << endl;
+}
+
 void paramError(const char* progname, const char* err) noexcept{
 
    if(err != nullptr) cerr << err << "\n\n";
@@ -132,8 +468,12 @@ void paramError(const char* progname, const char* err) noexcept{
         << "       "  << "   representation (01234567890ABCD#*) received on stdin.   \n"   
         << "  or   \n"
         << "       "  << progname << " [ -b input file to convert] [-t tone file] \n" 
-        << "       "              << " [-c input file to convert]\n" 
-        << "       "              << " [-o output file] [-s string to play]\n"
+        << "       "              << " [-c input file to convert] [-d wav file] [-R]\n" 
+        << "       "              << " [-m MT8870 tone file] [-i space|invalid]\n" 
+        << "       "              << " [-j threads] [-n lanes] [-F] [-z] [-v]\n" 
+        << "       "              << " [-x file to transmit] [-e devices]\n" 
+        << "       "              << " [-a link model] [-l capture device|wav file]\n" 
+        << "       "              << " [-o output file] [-s string to play] [-k tone bank] [-S]\n"
         << "       "              << " | [-h] | [-V]  \n\n" 
         << "       "  << "-b input file to convert.                                    \n" 
         << "       "  << "   It is a regular file (binary or text) that will be        \n" 
@@ -141,14 +481,65 @@ void paramError(const char* progname, const char* err) noexcept{
         << "       "  << "-c input file to convert.                                    \n" 
         << "       "  << "   It is a regular file (binary or text) that will be        \n" 
         << "       "  << "   converted in tone coding for MT8870 IOT adapter           \n" 
+        << "       "  << "-m MT8870 tone file.                                         \n" 
+        << "       "  << "   A tone file produced by -c, converted back to the initial \n" 
+        << "       "  << "   file; frames failing the parity check are reported.       \n" 
         << "       "  << "-t tone file.                                                \n" 
         << "       "  << "   It contains a sequence of tones that will be converted    \n" 
         << "       "  << "   back to the initial file (binary or text).                \n" 
+        << "       "  << "-i space|invalid, with -t or -m: skip whitespace or any      \n" 
+        << "       "  << "   invalid symbol (-t) or corrupted frame (-m) instead of    \n" 
+        << "       "  << "   stopping at the first one, whose offset is reported.      \n" 
+        << "       "  << "-j threads, with -b, -t or -d: convert chunks of the file in \n" 
+        << "       "  << "   parallel; 0 uses all the cores (default 1). -d cuts the   \n" 
+        << "       "  << "   recording at the gaps between tones.                      \n" 
+        << "       "  << "-F with -b or -t: frames with CRC and Reed-Solomon parity,   \n" 
+        << "       "  << "   up to 8 wrong bytes every 64 are corrected by -t.         \n" 
+        << "       "  << "-z with -b or -x: compress the file before the encoding;     \n" 
+        << "       "  << "   -t detects compressed data and restores the original.     \n" 
+        << "       "  << "-n lanes, with -b, -t, -d or -x: stripe the file over lanes, \n" 
+        << "       "  << "   each led by a header; -b writes one tone file per lane,   \n" 
+        << "       "  << "   output.0, output.1 ..., -t reassembles them, -d saves     \n" 
+        << "       "  << "   every channel of the recording as a lane tone file.       \n" 
+        << "       "  << "-x file to transmit over -n channels (default 1) of every   \n" 
+        << "       "  << "   device, in parallel; -w renders a multichannel wav file.  \n" 
+        << "       "  << "-e devices, with -x: comma separated ALSA devices, default   \n" 
+        << "       "  << "   is 'default'.                                             \n" 
+        << "       "  << "-d wav file.                                                 \n" 
+        << "       "  << "   A recording (U8, S16 or float) whose tones will be        \n" 
+        << "       "  << "   detected and saved as a tone file, suitable for -t.       \n" 
+        << "       "  << "-R with -d: recover the symbol clock, for tapes whose speed  \n" 
+        << "       "  << "   wanders: bridge short dropouts and split a tone lasting   \n" 
+        << "       "  << "   n times the others, with no gap, into n repeats.          \n" 
+        << "       "  << "-l capture device or wav file: decode the tones live, a     \n" 
+        << "       "  << "   period at a time, into -o until the end or ctrl-c; -f and \n" 
+        << "       "  << "   -r set the capture format (default s16) and rate.         \n" 
         << "       "  << "-o output file.                                              \n" 
-        << "       "  << "   This flag is necessary if -b or -t is specified.          \n" 
+        << "       "  << "   Necessary if -b, -c, -m, -t, -d or -l is specified.       \n" 
         << "       "  << "   This file will contain the encoded/decode data.           \n" 
         << "       "  << "-s A string with one or more ascii representation of tones   \n" 
         << "       "  << "   (01234567890ABCD#*) that will be reproduced by sound card \n"
+        << "       "  << "-w wav file.                                                 \n" 
+        << "       "  << "   Render the tones to this file instead of the sound card:  \n" 
+        << "       "  << "   the string given with -s or, alone, the tones on stdin.   \n" 
+        << "       "  << "-p timing profile.                                           \n" 
+        << "       "  << "   classic (250 ms tones, default), fast (100 ms tones),     \n" 
+        << "       "  << "   itu (ITU Q.24 minimums: 40 ms tones, 40 ms gaps) or a     \n" 
+        << "       "  << "   custom tone:gap[:pause] in milliseconds, e.g. 60:40:200.  \n" 
+        << "       "  << "-f sample format: u8 (default), s16 or float.                \n" 
+        << "       "  << "-r sample rate in Hz (default 8000) or 'native' to use the   \n" 
+        << "       "  << "   rate of the sound card, avoiding ALSA resampling.         \n" 
+        << "       "  << "-v verbose: log every read from stdin, or with -l every      \n" 
+        << "       "  << "   symbol received and its time; with -d the tone and gap    \n" 
+        << "       "  << "   lengths measured in the recording.                        \n" 
+        << "       "  << "-k tone bank file, with -s or stdin: map the tones saved     \n" 
+        << "       "  << "   there, or save them for the next run if it's missing.     \n" 
+        << "       "  << "-S with -s or stdin: print playback statistics at exit: xruns,\n" 
+        << "       "  << "   short writes, write latencies and achieved symbol rate.   \n" 
+        << "       "  << "-a link model: clean or noise[:cutoff[:drift]], e.g.        \n" 
+        << "       "  << "   0.05:3000:0.005 (noise RMS, low-pass Hz, speed error).    \n" 
+        << "       "  << "   Search, in memory, the shortest tones and gaps decoded    \n" 
+        << "       "  << "   without errors and print a profile for -p, with margin.   \n" 
         << "       "  << "-h print this help message. \n"                                    
         << "       "  << "-V version information.";
 